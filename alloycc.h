@@ -8,7 +8,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <assert.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -17,6 +19,9 @@ typedef struct Type Type;
 typedef struct Hideset Hideset;
 typedef struct Member Member;
 typedef struct Relocation Relocation;
+typedef struct Incbin Incbin;
+typedef struct AsmOperand AsmOperand;
+typedef struct Function Function;
 
 //
 // tokenize.c
@@ -27,26 +32,115 @@ typedef enum {
   TK_IDENT,
   TK_STR,
   TK_NUM,
+  TK_EMBED,
   TK_EOF,
 } TokenKind;
 
-typedef struct Token Token;
-struct Token {
-  TokenKind kind;  // token kind
-  Token *next;     // next token
+// punctuators and keywords are identified when they are lexed, so that the
+// parser compares integers rather than text. a single-character punctuator
+// is identified by the character itself. the keywords that can start a type
+// come first (see is_typename)
+typedef enum {
+  ID_NONE,
+
+  OP_SHL_ASSIGN = 128, // <<=
+  OP_SHR_ASSIGN,       // >>=
+  OP_ELLIPSIS,         // ...
+  OP_EQ,               // ==
+  OP_NE,               // !=
+  OP_GE,               // >=
+  OP_LE,               // <=
+  OP_ARROW,            // ->
+  OP_ADD_ASSIGN,       // +=
+  OP_SUB_ASSIGN,       // -=
+  OP_MUL_ASSIGN,       // *=
+  OP_DIV_ASSIGN,       // /=
+  OP_MOD_ASSIGN,       // %=
+  OP_INC,              // ++
+  OP_DEC,              // --
+  OP_AND_ASSIGN,       // &=
+  OP_OR_ASSIGN,        // |=
+  OP_XOR_ASSIGN,       // ^=
+  OP_LOGAND,           // &&
+  OP_LOGOR,            // ||
+  OP_SHL,              // <<
+  OP_SHR,              // >>
+  OP_PASTE,            // ##
+
+  KW_VOID,
+  KW_BOOL,
+  KW_SIGNED,
+  KW_UNSIGNED,
+  KW_CHAR,
+  KW_SHORT,
+  KW_INT,
+  KW_LONG,
+  KW_FLOAT,
+  KW_DOUBLE,
+  KW_STRUCT,
+  KW_UNION,
+  KW_TYPEDEF,
+  KW_ENUM,
+  KW_EXTERN,
+  KW_STATIC,
+  KW_ALIGNAS,
+  KW_CONST,
+  KW_VOLATILE,
+  KW_ATOMIC,
+  KW_THREAD_LOCAL,
+  KW_ATTRIBUTE,
+
+  KW_IF,
+  KW_ELSE,
+  KW_DO,
+  KW_WHILE,
+  KW_FOR,
+  KW_BREAK,
+  KW_CONTINUE,
+  KW_GOTO,
+  KW_SWITCH,
+  KW_CASE,
+  KW_DEFAULT,
+  KW_RETURN,
+  KW_SIZEOF,
+  KW_ALIGNOF,
+  KW_ASM,
+} TokenId;
+
+// a tokenized input: a source file, or text made up during preprocessing.
+// tokens refer to it by its index in the source table
+typedef struct {
+  char *name;        // input filename
+  char *contents;    // entire input string
+  int file_no;       // file number: for .loc directive
+  int *line_offsets; // offsets of the starts of the lines after the first
+  int line_count;
+} File;
+
+// the payload of a literal token, kept in a side table
+typedef struct {
   long val;        // its integer value (used for TK_NUM)
   double fval;     // its floating point value (used for TK_NUM)
   Type *ty;        // used if TK_NUM
-  char *str;       // start of token in original input
-  int len;         // token length (in original input)
 
   char *contents;  // string literal contents, including '\0' terminator
   int cont_len;    // string literal length
 
-  char *filename;  // input filename
-  char *input;     // entire input string
+  char *embed_path; // resource path (used if TK_EMBED, whose contents are read lazily)
+} Literal;
+
+// tokens are allocated from an arena, and keep only what every token needs
+typedef struct Token Token;
+struct Token {
+  TokenKind kind;  // token kind
+  TokenId id;      // punctuator or keyword, if any
+  Token *next;     // next token
+  char *str;       // start of token in original input
+  int len;         // token length (in original input)
+  char *name;      // interned spelling, if an identifier or a keyword
   int line_no;     // line number: for debugging
-  int file_no;     // file number: for .loc directivbe
+  int file;        // index in the source table
+  int lit;         // index in the literal table, or 0 if not a literal
   bool at_bol;     // true if this token is at beginning of line
   bool has_space;  // true if this token follows a space character
   Hideset *hideset; // for macro expansion
@@ -59,6 +153,8 @@ void warn_tok(Token *tok, char *fmt, ...);
 bool equal(Token *tok, char *op);
 bool consume(Token **rest, Token *tok, char *op);
 Token *skip(Token *tok, char *op);
+bool consume_id(Token **rest, Token *tok, TokenId id);
+Token *skip_id(Token *tok, TokenId id);
 
 char *expect_ident(Token **rest, Token *tok);
 char *get_identifier(Token *tok);
@@ -67,12 +163,22 @@ void convert_keywords(Token *tok);
 
 Token *tokenize(char *filename, int file_no, char  *p);
 Token *tokenize_file(char *path);
+int new_file_no(char *path);
+void bench_lex(char *path);
+Token *alloc_token(void);
+char *intern(char *s, int len);
+File *token_file(Token *tok);
+Literal *token_lit(Token *tok);
+Literal *new_literal(Token *tok);
 extern char *current_filename;
 
 //
 // preprocess.c
 //
 Token *preprocess(Token *tok);
+char *quote_string(char *str);
+char *embed_contents(Token *tok);
+void expand_embed(Token *tok);
 
 //
 // parser.c
@@ -115,19 +221,44 @@ typedef enum {
   ND_BREAK,     // "break"
   ND_CONTINUE,  // "continue"
   ND_GOTO,      // "goto"
+  ND_GOTO_EXPR, // "goto" "*" (GNU extension)
   ND_LABEL,     // labeled statement
+  ND_LABEL_VAL, // "&&" label (GNU extension)
   ND_RETURN,    // "return"
   ND_BLOCK,     // compound statement
   ND_EXPR_STMT, // statement with expression (w/o return)
   ND_STMT_EXPR, // statement expression (GNU extension)
   ND_FUNCALL,   // function call
   ND_NULL_EXPR, // do nothing
+  ND_MEMZERO,   // zero-clear a local variable
+  ND_ASM,       // "asm"
+  ND_CAS,       // atomic compare-and-swap
+  ND_EXCH,      // atomic exchange
+  ND_FETCH_ADD, // atomic fetch-and-add
+  ND_FENCE,     // memory fence
+  ND_BUILTIN,   // builtin function lowered inline
+  ND_VLA_PTR,   // the pointer slot of a variable-length array
 
   ND_VAR,       // local variables
   ND_NUM,       // Integer
   ND_CAST,      // type cast
 } NodeKind;
 
+// builtin functions lowered to inline code (see builtin() in parse.c)
+typedef enum {
+  BI_VA_START,    // __builtin_va_start
+  BI_POPCOUNT,    // __builtin_popcount{,l,ll}
+  BI_CLZ,         // __builtin_clz{,l,ll}
+  BI_CTZ,         // __builtin_ctz{,l,ll}
+  BI_BSWAP,       // __builtin_bswap{16,32,64}
+  BI_EXPECT,      // __builtin_expect
+  BI_PREFETCH,    // __builtin_prefetch
+  BI_UNREACHABLE, // __builtin_unreachable
+  BI_MEMCPY,      // __builtin_memcpy
+  BI_MEMSET,      // __builtin_memset
+  BI_ALLOCA,      // __builtin_alloca
+} BuiltinKind;
+
 typedef struct Var Var;
 struct Var {
   Var *next;
@@ -142,18 +273,48 @@ struct Var {
 
   // for global variables
   bool is_static;
+  bool is_definition; // defined (emitted) in this translation unit
+  bool is_tls;        // _Thread_local
+  bool is_cold;       // function declared __attribute__((cold))
+  bool is_live;   // reachable from non-static symbols (set by codegen)
   char *init_data;
   Relocation *rel;
+  Incbin *incbin;
+
+  // for functions
+  Function *fn;   // function definition, if any
 };
 
 // used for gloval vars initialization using a pointer to another global vars
 struct Relocation {
   Relocation *next;
   int offset;
-  char *label;
+  Var *var;
   long addend;
 };
 
+// used for gloval vars initialized with #embed, emitted with `.incbin`
+struct Incbin {
+  Incbin *next;
+  int offset;
+  int len;
+  char *path;
+};
+
+// operand of an extended asm statement
+struct AsmOperand {
+  AsmOperand *next;
+  char *name;       // symbolic name ("[name]"), if any
+  char kind;        // 'r', 'x', 'm', 'i' or one of "abcdSD" (specific register)
+  int match;        // output operand number for a matching constraint, or -1
+  bool is_output;
+  Type *ty;         // type of the operand expression
+  Var *ptr;         // address of an output or of a memory operand
+  Var *val;         // value to be loaded before the asm
+  long imm;         // value of an immediate operand
+  int reg;          // register assigned by codegen
+};
+
 typedef struct Node Node;
 struct Node {
   NodeKind kind;
@@ -188,6 +349,22 @@ struct Node {
 
   // Goto or labeled statement
   char *label_name;
+  Node *label_next; // labels, or "&&" operands, of the same function
+
+  // builtin function
+  BuiltinKind builtin;
+  Node *size;           // byte count for memcpy/memset, unless constant (val)
+
+  // atomic compare-and-swap
+  Node *cas_addr;
+  Node *cas_old;
+  Node *cas_new;
+
+  // inline assembly
+  char *asm_str;
+  AsmOperand *asm_ops;  // outputs followed by inputs
+  char **asm_clobbers;  // NULL-terminated
+  bool asm_is_basic;    // no operand list (the template is not substituted)
 
   // switch-cases
   Node *case_next;
@@ -203,16 +380,19 @@ struct Node {
   double fval;
 };
 
-typedef struct Function Function;
 struct Function {
   Function *next;
   char *name;
   Var *params;
   bool is_static;
   bool is_variadic;
+  bool is_cold;   // placed in .text.unlikely
+  bool is_live;   // reachable from non-static symbols (set by codegen)
 
   Node *node;
   Var *locals;
+  Var *alloca_bottom; // lowest address allocated by alloca or VLAs, if used
+  Var *struct_ret;    // address of the caller's buffer, for a struct returned in memory
   int stack_size;
 };
 
@@ -236,6 +416,9 @@ void codegen(Program *prog);
 // main.c
 //
 extern bool opt_E;
+extern bool opt_stats;
+extern bool opt_fpic;
+extern bool opt_fpie;
 extern char **include_paths;
 
 //
@@ -255,6 +438,8 @@ typedef enum {
   TY_FUNC,
   TY_ARRAY,
   TY_STRUCT,
+  TY_VECTOR,
+  TY_VLA,     // variable-length array
 } TypeKind;
 
 struct Type {
@@ -264,6 +449,7 @@ struct Type {
   bool is_unsigned;   // unsigned or signed
   bool is_incomplete; // incomplete type
   bool is_const;      // const
+  bool is_atomic;     // _Atomic
   Type *base;
 
   // used for declaration
@@ -275,10 +461,15 @@ struct Type {
   Type *params;
   bool is_variadic;
   Type *next;
+  Var *param_var; // a parameter's variable, which later parameters may refer to
 
-  // array
+  // array (and vector: `base` is the element type, `array_len` the lane count)
   int array_len;
 
+  // variable-length array: the variable holds a pointer to the elements
+  Node *vla_len;  // number of elements
+  Var *vla_size;  // sizeof, computed when the type is declared
+
   // struct
   Member *members;
 };
@@ -314,11 +505,14 @@ Type *pointer_to(Type *base);
 Type *copy_ty(Type *ty);
 Type *func_returning(Type *ty);
 Type *array_of(Type *ty, int len);
+Type *vector_of(Type *base, int size);
+Type *vla_of(Type *base, Node *len);
 Type *enum_type(void);
 Type *struct_type(void);
 int size_of(Type *ty);
 bool is_integer(Type *ty);
 bool is_flonum(Type *ty);
 bool is_numeric(Type *ty);
+bool is_vector(Type *ty);
 bool is_pointer_like(Type *ty);
 void generate_type(Node *node);
@@ -11,6 +11,7 @@ static void load(Type *ty);
 static void store(Type *ty);
 static void pop_to(char *rg, Type *ty);
 static void push_from(char *rg, Type *ty);
+static void copy_bytes(int sz);
 
 static int labelseq = 1;
 static int brkseq;
@@ -19,8 +20,35 @@ static const char *argreg8[]  = { "dil", "sil", "dl", "cl", "r8l", "r9l" };
 static const char *argreg16[] = { "di",  "si",  "dx", "cx", "r8w", "r9w" };
 static const char *argreg32[] = { "edi", "esi", "edx", "ecx", "r8d", "r9d" };
 static const char *argreg64[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+static int argreg_idx[] = { 7, 6, 2, 1, 8, 9 }; // the same, as indices into asm_reg*
 static Function  *current_fn;
 
+// registers in x86 encoding order (used for inline assembly and atomics)
+static char *asm_reg8[]  = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+                            "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+static char *asm_reg16[] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+                            "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"};
+static char *asm_reg32[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+                            "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+static char *asm_reg64[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+                            "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"};
+static char *asm_reg8h[] = {"ah", "ch", "dh", "bh"};
+
+// a branch judged unlikely is not emitted in place; it is queued here and
+// emitted after the function's epilogue, in .text.unlikely, so that the hot
+// path falls through without jumping over it
+typedef struct ColdBlock ColdBlock;
+struct ColdBlock {
+  ColdBlock *next;
+  Node *stmt;
+  int seq;
+  int brkseq;
+  int contseq;
+};
+static ColdBlock *cold_blocks;
+
+#define REG_RBX 3
+
 static char *reg(Type *ty, int idx, bool treat_integer_as64) {
   static char *reg64[] = {"rax", "rsi", "rdi"};
   static char *reg32[] = {"eax", "esi", "edi"};
@@ -35,18 +63,56 @@ static char *reg(Type *ty, int idx, bool treat_integer_as64) {
   return treat_integer_as64 ? reg64[idx] : reg32[idx];
 }
 
+// whether `var` is known to resolve within the module being built, so that
+// it can be addressed pc-relative rather than through the GOT
+static bool is_local_symbol(Var *var) {
+  // position-dependent code is linked statically (or with copy relocations)
+  if (!opt_fpic && !opt_fpie)
+    return true;
+
+  bool defined = (var->ty->kind == TY_FUNC) ? var->fn != NULL : var->is_definition;
+  if (!defined)
+    return false;
+
+  // exported symbols of a shared library can be preempted by other modules
+  return var->is_static || !opt_fpic;
+}
+
 static void gen_addr(Node *node) {
   switch (node->kind) {
     case ND_VAR:
-      if (node->var->is_local) {
+      if (node->var->ty->kind == TY_VLA) {
+        // the elements are where the VLA's pointer slot points
+        printf("  mov rax, [rbp-%d]\n", node->var->offset);
+        printf("  push rax\n");
+      } else if (node->var->is_local) {
         printf("  mov rax, rbp\n");
         printf("  sub rax, %d\n", node->var->offset);
         printf("  push rax\n");
+      } else if (node->var->is_tls && node->var->is_definition && !opt_fpic) {
+        // local-exec: fixed offset from the thread pointer
+        printf("  mov rax, QWORD PTR fs:0\n");
+        printf("  add rax, OFFSET FLAT:%s@tpoff\n", node->var->name);
+        printf("  push rax\n");
+      } else if (node->var->is_tls) {
+        // initial-exec: the offset is loaded from the GOT (also used for
+        // shared libraries, which are then expected to be loaded at startup)
+        printf("  mov rax, QWORD PTR %s@gottpoff[rip]\n", node->var->name);
+        printf("  add rax, QWORD PTR fs:0\n");
+        printf("  push rax\n");
+      } else if (is_local_symbol(node->var)) {
+        printf("  lea rax, %s[rip]\n", node->var->name);
+        printf("  push rax\n");
       } else {
-        printf("  mov rax, offset %s\n", node->var->name);
+        printf("  mov rax, QWORD PTR %s@GOTPCREL[rip]\n", node->var->name);
         printf("  push rax\n");
       }
       return;
+    case ND_VLA_PTR:
+      printf("  mov rax, rbp\n");
+      printf("  sub rax, %d\n", node->var->offset);
+      printf("  push rax\n");
+      return;
     case ND_DEREF: // *(foo + 8) = 123; (DEREF as lvalue)
       gen_expr(node->lhs);
       return;
@@ -55,6 +121,13 @@ static void gen_addr(Node *node) {
       printf("  add rsp, 8\n");
       gen_addr(node->rhs);
       return;
+    case ND_FUNCALL:
+      // the value of a returned struct is the address of its buffer
+      if (node->ty->kind == TY_STRUCT) {
+        gen_expr(node);
+        return;
+      }
+      break;
     case ND_MEMBER:
       gen_addr(node->lhs);
       printf("  pop rax\n");
@@ -67,7 +140,8 @@ static void gen_addr(Node *node) {
 }
 
 static void load(Type *ty) {
-  if (ty->kind == TY_ARRAY || ty->kind == TY_STRUCT || ty->kind == TY_FUNC) {
+  if (ty->kind == TY_ARRAY || ty->kind == TY_STRUCT || ty->kind == TY_FUNC ||
+      ty->kind == TY_VECTOR || ty->kind == TY_VLA) {
     // NOOP for array type node
     // an entire array cannot be "loaded". Instead the variable
     // is interperted as the address of the first element
@@ -106,6 +180,35 @@ static void load(Type *ty) {
   printf("  push rax\n");
 }
 
+// register `idx` (in encoding order) of `sz` bytes
+static char *sized_reg(int idx, int sz) {
+  if (sz == 1)
+    return asm_reg8[idx];
+  if (sz == 2)
+    return asm_reg16[idx];
+  if (sz == 4)
+    return asm_reg32[idx];
+  return asm_reg64[idx];
+}
+
+// extends the result of an atomic operation in rax to 64 bits
+static void extend_rax(Type *ty) {
+  switch (size_of(ty)) {
+  case 1:
+    printf("  %s rax, al\n", ty->is_unsigned ? "movzx" : "movsx");
+    return;
+  case 2:
+    printf("  %s rax, ax\n", ty->is_unsigned ? "movzx" : "movsx");
+    return;
+  case 4:
+    if (ty->is_unsigned || is_flonum(ty))
+      printf("  mov eax, eax\n");
+    else
+      printf("  movsxd rax, eax\n");
+    return;
+  }
+}
+
 static void store(Type *ty) {
   int sz = size_of(ty);
 
@@ -113,11 +216,18 @@ static void store(Type *ty) {
   printf("  pop rsi\n"); // rhs
   printf("  pop rdi\n"); // lhs (lvalue)
 
-  if (ty->kind == TY_STRUCT) {
+  if (ty->is_atomic && ty->kind != TY_STRUCT) {
+    // seq_cst store (xchg is implicitly locked)
+    printf("  mov rax, rsi\n");
+    printf("  xchg [rdi], %s\n", sized_reg(0, sz));
+  } else if (ty->kind == TY_STRUCT) {
     for (int i = 0; i < sz; i++) {
       printf("  mov al, [rsi+%d]\n", i);
       printf("  mov [rdi+%d], al\n", i);
     }
+  } else if (ty->kind == TY_VECTOR) {
+    printf("  movups xmm0, [rsi]\n");
+    printf("  movups [rdi], xmm0\n");
   } else if (ty->kind == TY_FLOAT) {
     // NOTE:
     // in-memory flonum can be treated as a mere 32/64bit "integer",
@@ -259,70 +369,306 @@ static void cast(Type *from, Type *to) {
   printf("  push rax\n");
 }
 
+// SysV x86-64 classification of structs: a struct larger than 16 bytes is
+// passed in memory. otherwise each of its (at most two) eightbytes is passed
+// in an SSE register if it holds floating-point members only, or in a
+// general-purpose register if not.
+static bool has_flonum(Type *ty, int lo, int hi, int offset) {
+  if (ty->kind == TY_STRUCT) {
+    for (Member *mem = ty->members; mem; mem = mem->next)
+      if (!has_flonum(mem->ty, lo, hi, offset + mem->offset))
+        return false;
+    return true;
+  }
+
+  if (ty->kind == TY_ARRAY) {
+    for (int i = 0; i < ty->array_len; i++)
+      if (!has_flonum(ty->base, lo, hi, offset + size_of(ty->base) * i))
+        return false;
+    return true;
+  }
+
+  return offset < lo || hi <= offset || is_flonum(ty);
+}
+
+static bool is_sse_part(Type *ty, int part) {
+  return has_flonum(ty, part * 8, part * 8 + 8, 0);
+}
+
+static bool in_memory(Type *ty) {
+  return ty->kind == TY_STRUCT && size_of(ty) > 16;
+}
+
+// decides where an argument goes: returns true if it is passed on the stack,
+// otherwise takes the registers it needs from `*gp` and `*fp`
+static bool pass_by_stack(Type *ty, int *gp, int *fp) {
+  if (ty->kind != TY_STRUCT) {
+    if (is_flonum(ty) || is_vector(ty))
+      return (*fp)++ >= 8;
+    return (*gp)++ >= 6;
+  }
+
+  if (in_memory(ty))
+    return true;
+
+  int ngp = 0, nfp = 0;
+  for (int part = 0; part * 8 < size_of(ty); part++)
+    if (is_sse_part(ty, part))
+      nfp++;
+    else
+      ngp++;
+
+  // a struct is never split between registers and the stack
+  if (*gp + ngp > 6 || *fp + nfp > 8)
+    return true;
+  *gp += ngp;
+  *fp += nfp;
+  return false;
+}
+
+// offset of a stack-passed argument of type `ty`, placed after `offset` bytes of others
+static int stack_arg_offset(Type *ty, int offset) {
+  return align_to(offset, ty->align > 8 ? 16 : 8);
+}
+
+// loads the `part`-th eightbyte of the struct at [base+disp] into xmm`reg`
+// (for an SSE part) or asm_reg64[reg], without reading past its end
+static void load_part(Type *ty, int part, int reg, char *base, int disp) {
+  int sz = size_of(ty) - part * 8;
+  if (sz > 8)
+    sz = 8;
+  disp += part * 8;
+
+  if (is_sse_part(ty, part)) {
+    if (sz == 4)
+      printf("  movss xmm%d, dword ptr [%s%+d]\n", reg, base, disp);
+    else
+      printf("  movsd xmm%d, qword ptr [%s%+d]\n", reg, base, disp);
+    return;
+  }
+
+  switch (sz) {
+  case 1:
+    printf("  movzx %s, byte ptr [%s%+d]\n", asm_reg32[reg], base, disp);
+    return;
+  case 2:
+    printf("  movzx %s, word ptr [%s%+d]\n", asm_reg32[reg], base, disp);
+    return;
+  case 4:
+    printf("  mov %s, dword ptr [%s%+d]\n", asm_reg32[reg], base, disp);
+    return;
+  case 8:
+    printf("  mov %s, [%s%+d]\n", asm_reg64[reg], base, disp);
+    return;
+  }
+
+  printf("  mov %s, 0\n", asm_reg64[reg]);
+  for (int i = sz - 1; i >= 0; i--) {
+    printf("  shl %s, 8\n", asm_reg64[reg]);
+    printf("  mov %s, byte ptr [%s%+d]\n", asm_reg8[reg], base, disp + i);
+  }
+}
+
+// stores a register loaded by load_part() back to memory
+static void store_part(Type *ty, int part, int reg, char *base, int disp) {
+  int sz = size_of(ty) - part * 8;
+  if (sz > 8)
+    sz = 8;
+  disp += part * 8;
+
+  if (is_sse_part(ty, part)) {
+    if (sz == 4)
+      printf("  movss dword ptr [%s%+d], xmm%d\n", base, disp, reg);
+    else
+      printf("  movsd qword ptr [%s%+d], xmm%d\n", base, disp, reg);
+    return;
+  }
+
+  if (sz == 1 || sz == 2 || sz == 4 || sz == 8) {
+    printf("  mov [%s%+d], %s\n", base, disp, sized_reg(reg, sz));
+    return;
+  }
+
+  for (int i = 0; i < sz; i++) {
+    printf("  mov byte ptr [%s%+d], %s\n", base, disp + i, asm_reg8[reg]);
+    printf("  shr %s, 8\n", asm_reg64[reg]);
+  }
+}
+
+// returns the size of the outgoing area for the stack-passed arguments of a call
+static int stack_args_size(Node *node) {
+  int gp = in_memory(node->ty), fp = 0, size = 0;
+
+  for (int i = 0; i < node->nargs; i++) {
+    Type *ty = node->args[i]->ty;
+    if (pass_by_stack(ty, &gp, &fp))
+      size = stack_arg_offset(ty, size) + align_to(size_of(ty), 8);
+  }
+  return align_to(size, 16);
+}
+
+// loads an integer (or pointer) argument from its temporary into a register,
+// extended to 64 bits. callees built by other compilers may rely on the
+// extension, for stack-passed arguments too
+static void load_int_arg(Type *ty, int offset, int reg) {
+  int sz = size_of(ty);
+  char *insn = ty->is_unsigned ? "movzx" : "movsx";
+
+  if (sz == 1)
+    printf("  %s %s, byte ptr [rbp-%d]\n", insn, asm_reg64[reg], offset);
+  else if (sz == 2)
+    printf("  %s %s, word ptr [rbp-%d]\n", insn, asm_reg64[reg], offset);
+  else if (sz == 4 && ty->is_unsigned)
+    printf("  mov %s, dword ptr [rbp-%d]\n", asm_reg32[reg], offset);
+  else if (sz == 4)
+    printf("  movsxd %s, dword ptr [rbp-%d]\n", asm_reg64[reg], offset);
+  else
+    printf("  mov %s, [rbp-%d]\n", asm_reg64[reg], offset);
+}
+
 // set in-stack arguments into the registers required by ABI, before invoking a func call
 // also set number of floating point args to rax
 // (* take extra care not to destroy rax values before calling)
 static void load_args(Node *node) {
+  int gp = in_memory(node->ty), fp = 0, offset = 0;
+
+  // copy the stack-passed arguments to the outgoing area first,
+  // as copying uses some of the argument registers
+  for (int i = 0; i < node->nargs; i++) {
+    Var *arg = node->args[i];
+    if (!pass_by_stack(arg->ty, &gp, &fp))
+      continue;
+
+    offset = stack_arg_offset(arg->ty, offset);
+    if (is_integer(arg->ty) || arg->ty->kind == TY_PTR) {
+      load_int_arg(arg->ty, arg->offset, 0);
+      printf("  mov [rsp+%d], rax\n", offset);
+    } else {
+      printf("  lea rsi, [rbp-%d]\n", arg->offset);
+      printf("  lea rdi, [rsp+%d]\n", offset);
+      copy_bytes(size_of(arg->ty));
+    }
+    offset += align_to(size_of(arg->ty), 8);
+  }
+
+  gp = fp = 0;
+
+  // a struct returned in memory is written to a buffer whose address is
+  // passed as a hidden first argument
+  if (in_memory(node->ty))
+    printf("  lea %s, [rbp-%d]\n", argreg64[gp++], node->var->offset);
 
-  int gp = 0, fp = 0;
   for(int i = 0; i < node->nargs; i++) {
     Var *arg = node->args[i];
     int sz = size_of(arg->ty);
+    int gp1 = gp, fp1 = fp;
+
+    if (pass_by_stack(arg->ty, &gp, &fp))
+      continue;
+
+    // for structs passed in registers, one register per eightbyte
+    if (arg->ty->kind == TY_STRUCT) {
+      for (int part = 0; part * 8 < sz; part++) {
+        if (is_sse_part(arg->ty, part))
+          load_part(arg->ty, part, fp1++, "rbp", -arg->offset);
+        else
+          load_part(arg->ty, part, argreg_idx[gp1++], "rbp", -arg->offset);
+      }
+      continue;
+    }
 
-    // for floating-point arguments
-    if (is_flonum(arg->ty)) {
-      if (arg->ty->kind == TY_FLOAT)
-        printf("  movss xmm%d, DWORD PTR [rbp-%d]\n", fp++, arg->offset);
+    // for floating-point (and vector) arguments
+    if (is_flonum(arg->ty) || is_vector(arg->ty)) {
+      if (is_vector(arg->ty))
+        printf("  movups xmm%d, [rbp-%d]\n", fp1, arg->offset);
+      else if (arg->ty->kind == TY_FLOAT)
+        printf("  movss xmm%d, DWORD PTR [rbp-%d]\n", fp1, arg->offset);
       else if (arg->ty->kind == TY_DOUBLE)
-        printf("  movsd xmm%d, QWORD PTR [rbp-%d]\n", fp++, arg->offset);
+        printf("  movsd xmm%d, QWORD PTR [rbp-%d]\n", fp1, arg->offset);
       continue;
     }
 
     // for non floating-point arguments
-    char *insn = arg->ty->is_unsigned ? "movzx" : "movsx";
-
-    if (sz == 1)
-      printf("  %s %s, byte ptr [rbp-%d]\n", insn, argreg32[gp++], arg->offset);
-    else if (sz == 2)
-      printf("  %s %s, word ptr [rbp-%d]\n", insn, argreg32[gp++], arg->offset);
-    else if (sz == 4)
-      printf("  mov %s, dword ptr [rbp-%d]\n", argreg32[gp++], arg->offset);
-    else
-      printf("  mov %s, [rbp-%d]\n", argreg64[gp++], arg->offset);
+    load_int_arg(arg->ty, arg->offset, argreg_idx[gp1]);
   }
 
   // set number of floating point args
   printf("  mov rax, %d\n", fp);
 }
 
-static void store_args(Var *params) {
+// returns the parameters of `fn` in declaration order
+static Var **param_array(Function *fn, int *len) {
+  int n = 0;
+  for (Var *var = fn->params; var; var = var->next)
+    n++;
+
+  // fn->params is linked in reverse order
+  Var **params = calloc(n, sizeof(Var *));
+  int i = n;
+  for (Var *var = fn->params; var; var = var->next)
+    params[--i] = var;
+  *len = n;
+  return params;
+}
+
+static void store_args(Function *fn) {
+  int n;
+  Var **params = param_array(fn, &n);
   int gp = 0, fp = 0;
 
-  for (Var *arg = params; arg; arg = arg->next)
-    if (is_flonum(arg->ty))
-      fp++;
-    else
-      gp++;
+  if (fn->struct_ret)
+    printf("  mov [rbp-%d], %s\n", fn->struct_ret->offset, argreg64[gp++]);
 
-  for (Var *arg = params; arg; arg = arg->next) {
-    if (is_flonum(arg->ty)) {
-      if (arg->ty->kind == TY_FLOAT)
-        printf("  movss [rbp-%d], xmm%d\n", arg->offset, --fp);
+  for (int i = 0; i < n; i++) {
+    Var *arg = params[i];
+    int sz = size_of(arg->ty);
+    int gp1 = gp, fp1 = fp;
+
+    if (pass_by_stack(arg->ty, &gp, &fp))
+      continue;
+
+    if (arg->ty->kind == TY_STRUCT) {
+      for (int part = 0; part * 8 < sz; part++) {
+        if (is_sse_part(arg->ty, part))
+          store_part(arg->ty, part, fp1++, "rbp", -arg->offset);
+        else
+          store_part(arg->ty, part, argreg_idx[gp1++], "rbp", -arg->offset);
+      }
+    } else if (is_flonum(arg->ty) || is_vector(arg->ty)) {
+      if (is_vector(arg->ty))
+        printf("  movups [rbp-%d], xmm%d\n", arg->offset, fp1);
+      else if (arg->ty->kind == TY_FLOAT)
+        printf("  movss [rbp-%d], xmm%d\n", arg->offset, fp1);
       else if (arg->ty->kind == TY_DOUBLE)
-        printf("  movsd [rbp-%d], xmm%d\n", arg->offset, --fp);
+        printf("  movsd [rbp-%d], xmm%d\n", arg->offset, fp1);
     } else {
-      int sz = size_of(arg->ty);
-  
       if (sz == 1)
-        printf("  mov [rbp-%d], %s\n", arg->offset, argreg8[--gp]);
+        printf("  mov [rbp-%d], %s\n", arg->offset, argreg8[gp1]);
       else if (sz == 2)
-        printf("  mov [rbp-%d], %s\n", arg->offset, argreg16[--gp]);
+        printf("  mov [rbp-%d], %s\n", arg->offset, argreg16[gp1]);
       else if (sz == 4)
-        printf("  mov [rbp-%d], %s\n", arg->offset, argreg32[--gp]);
+        printf("  mov [rbp-%d], %s\n", arg->offset, argreg32[gp1]);
       else
-        printf("  mov [rbp-%d], %s\n", arg->offset, argreg64[--gp]);
+        printf("  mov [rbp-%d], %s\n", arg->offset, argreg64[gp1]);
     }
   }
+
+  // the stack-passed parameters, above the return address, are copied
+  // into the frame once the argument registers are free
+  gp = fn->struct_ret ? 1 : 0;
+  fp = 0;
+  int offset = 0;
+  for (int i = 0; i < n; i++) {
+    Var *arg = params[i];
+    if (!pass_by_stack(arg->ty, &gp, &fp))
+      continue;
+
+    offset = stack_arg_offset(arg->ty, offset);
+    printf("  lea rsi, [rbp+%d]\n", offset + 16);
+    printf("  lea rdi, [rbp-%d]\n", arg->offset);
+    copy_bytes(size_of(arg->ty));
+    offset += align_to(size_of(arg->ty), 8);
+  }
 }
 
 static void divmod(Node *node, char *rs, char *rd, char *res64, char *res32) {
@@ -349,34 +695,374 @@ static void divmod(Node *node, char *rs, char *rd, char *res64, char *res32) {
   }
 }
 
+// zero-clear a local variable with a single bulk fill: 16-byte SSE stores
+// for small objects, `rep stosq` for larger ones
+static void memzero(Var *var) {
+  int sz = size_of(var->ty);
+  int pos = 0;
+
+  printf("  lea rdi, [rbp-%d]\n", var->offset);
+
+  if (sz >= 128) {
+    printf("  mov ecx, %d\n", sz / 8);
+    printf("  xor eax, eax\n");
+    printf("  rep stosq\n"); // rdi is advanced past the filled area
+    sz %= 8;
+  } else {
+    printf("  xorps xmm0, xmm0\n");
+    for (; pos + 16 <= sz; pos += 16)
+      printf("  movups [rdi+%d], xmm0\n", pos);
+  }
+
+  // remaining tail
+  for (; pos + 8 <= sz; pos += 8)
+    printf("  mov qword ptr [rdi+%d], 0\n", pos);
+  if (pos + 4 <= sz) {
+    printf("  mov dword ptr [rdi+%d], 0\n", pos);
+    pos += 4;
+  }
+  if (pos + 2 <= sz) {
+    printf("  mov word ptr [rdi+%d], 0\n", pos);
+    pos += 2;
+  }
+  if (pos < sz)
+    printf("  mov byte ptr [rdi+%d], 0\n", pos);
+}
+
 static void builtin_va_start(Node *node) {
-  int gp = 0, fp = 0;
+  int n;
+  Var **params = param_array(current_fn, &n);
+  int gp = current_fn->struct_ret ? 1 : 0, fp = 0, offset = 0;
 
-  for (Var *var = current_fn->params; var; var = var->next)
-    if (is_flonum(var->ty))
-      fp++;
-    else
-      gp++;
+  for (int i = 0; i < n; i++)
+    if (pass_by_stack(params[i]->ty, &gp, &fp))
+      offset = stack_arg_offset(params[i]->ty, offset) + align_to(size_of(params[i]->ty), 8);
 
   // va_list given as the first argument
-  printf("  mov rax, [rbp-%d]\n", node->args[0]->offset);
+  gen_expr(node->lhs);
+  printf("  pop rax\n");
   // set gp_offset as n * 8
   // * gp_offset holds the offset in bytes from reg_save_area to the place
   //   where the next available general purpose argument register is saved
-  printf("  mov dword ptr [rax], %d\n", gp * 8);
-  // fp_ofset as 48 + fp * 8, where 48 is reserved space that is used to
+  printf("  mov dword ptr [rax], %d\n", (gp < 6 ? gp : 6) * 8);
+  // fp_ofset as 48 + fp * 16, where 48 is reserved space that is used to
   // embed rdi, rsi, rdx, rcx, r8, r9 (generenal-purpos argument registers referred above)
-  printf("  mov dword ptr [rax+4], %d\n", 48 + fp * 8);
+  // and each of xmm0-7 takes 16 bytes
+  printf("  mov dword ptr [rax+4], %d\n", 48 + (fp < 8 ? fp : 8) * 16);
 
-  // set reg_save_area as rbp-128
+  // the variadic arguments which didn't fit in registers follow the named
+  // ones on the stack
+  printf("  lea rdx, [rbp+%d]\n", offset + 16);
+  printf("  mov [rax+8], rdx\n");
+
+  // set reg_save_area as rbp-208
   printf("  mov [rax+16], rbp\n");
-  printf("  sub qword ptr [rax+16], 128\n");
+  printf("  sub qword ptr [rax+16], 208\n");
   // return with void value
   printf("  sub rsp, 8\n");
 }
 
+// the dynamically allocated area lies right below the fixed-size frame and
+// grows downwards; the temporaries pushed by an expression in progress are
+// below it. alloca moves those temporaries down by the allocated size, so
+// that the new block is placed right under the previous allocations.
+static void builtin_alloca(Node *node) {
+  int bottom = current_fn->alloca_bottom->offset;
+  int seq = labelseq++;
+
+  gen_expr(node->lhs);
+  printf("  pop rdi\n");
+  printf("  add rdi, 15\n");
+  printf("  and rdi, -16\n");
+
+  printf("  mov rsi, [rbp-%d]\n", bottom);
+  printf("  mov rcx, rsp\n");
+  printf("  sub rsp, rdi\n");
+  printf("  mov rdx, rsp\n");
+  printf(".L.alloca.%d:\n", seq);
+  printf("  cmp rcx, rsi\n");
+  printf("  je .L.alloca.end.%d\n", seq);
+  printf("  mov rax, [rcx]\n");
+  printf("  mov [rdx], rax\n");
+  printf("  add rcx, 8\n");
+  printf("  add rdx, 8\n");
+  printf("  jmp .L.alloca.%d\n", seq);
+  printf(".L.alloca.end.%d:\n", seq);
+
+  // the block starts where the moved temporaries end
+  printf("  mov [rbp-%d], rdx\n", bottom);
+  printf("  push rdx\n");
+}
+
+static void save_vla(Var *save) {
+  printf("  mov rax, [rbp-%d]\n", current_fn->alloca_bottom->offset);
+  printf("  mov [rbp-%d], rax\n", save->offset);
+}
+
+// releases everything allocated since `save` was taken, moving the pushed
+// temporaries back up (from the top, since the two areas may overlap)
+static void dealloc_vla(Var *save) {
+  int bottom = current_fn->alloca_bottom->offset;
+  int seq = labelseq++;
+
+  printf("  mov rcx, [rbp-%d]\n", bottom);
+  printf("  mov rdx, [rbp-%d]\n", save->offset);
+  printf("  mov [rbp-%d], rdx\n", bottom);
+  printf(".L.vla_free.%d:\n", seq);
+  printf("  cmp rcx, rsp\n");
+  printf("  je .L.vla_free.end.%d\n", seq);
+  printf("  sub rcx, 8\n");
+  printf("  sub rdx, 8\n");
+  printf("  mov rax, [rcx]\n");
+  printf("  mov [rdx], rax\n");
+  printf("  jmp .L.vla_free.%d\n", seq);
+  printf(".L.vla_free.end.%d:\n", seq);
+  printf("  mov rsp, rdx\n");
+}
+
+// copies `sz` bytes from [rsi] to [rdi] with unrolled moves
+static void copy_bytes(int sz) {
+  int pos = 0;
+  for (; sz - pos >= 16; pos += 16) {
+    printf("  movups xmm0, [rsi+%d]\n", pos);
+    printf("  movups [rdi+%d], xmm0\n", pos);
+  }
+  for (int width = 8; width > 0; width /= 2) {
+    for (; sz - pos >= width; pos += width) {
+      printf("  mov %s, [rsi+%d]\n", sized_reg(0, width), pos);
+      printf("  mov [rdi+%d], %s\n", pos, sized_reg(0, width));
+    }
+  }
+}
+
+// fills `sz` bytes at [rdi] with the byte pattern in rax
+static void fill_bytes(int sz) {
+  int pos = 0;
+  if (sz >= 16) {
+    printf("  movq xmm0, rax\n");
+    printf("  punpcklqdq xmm0, xmm0\n");
+  }
+  for (; sz - pos >= 16; pos += 16)
+    printf("  movups [rdi+%d], xmm0\n", pos);
+  for (int width = 8; width > 0; width /= 2)
+    for (; sz - pos >= width; pos += width)
+      printf("  mov [rdi+%d], %s\n", pos, sized_reg(0, width));
+}
+
+// constant-sized memcpy/memset up to this many bytes is unrolled;
+// anything else uses `rep movsb`/`rep stosb`
+#define INLINE_MEM_MAX 128
+
+static void gen_builtin(Node *node) {
+  switch (node->builtin) {
+  case BI_VA_START:
+    builtin_va_start(node);
+    return;
+  case BI_POPCOUNT:
+  case BI_CLZ:
+  case BI_CTZ:
+  case BI_BSWAP: {
+    gen_expr(node->lhs);
+    printf("  pop rax\n");
+    int sz = size_of(node->lhs->ty);
+    char *rs = sized_reg(0, sz);
+
+    if (node->builtin == BI_POPCOUNT) {
+      printf("  popcnt %s, %s\n", rs, rs);
+    } else if (node->builtin == BI_CLZ) {
+      // lzcnt would be a plain bsr on CPUs without it, giving a different result
+      printf("  bsr %s, %s\n", rs, rs);
+      printf("  xor %s, %d\n", rs, sz * 8 - 1);
+    } else if (node->builtin == BI_CTZ) {
+      // tzcnt runs as bsf on older CPUs, which agrees for non-zero input
+      printf("  tzcnt %s, %s\n", rs, rs);
+    } else if (sz == 2) {
+      printf("  rol ax, 8\n");
+      printf("  movzx eax, ax\n");
+    } else {
+      printf("  bswap %s\n", rs);
+    }
+    printf("  push rax\n");
+    return;
+  }
+  case BI_EXPECT:
+    gen_expr(node->lhs);
+    return;
+  case BI_PREFETCH: {
+    static char *insn[] = {"prefetchnta", "prefetcht2", "prefetcht1", "prefetcht0"};
+    gen_expr(node->lhs);
+    printf("  pop rax\n");
+    printf("  %s [rax]\n", insn[(node->val < 0 || node->val > 3) ? 3 : node->val]);
+    printf("  sub rsp, 8\n");
+    return;
+  }
+  case BI_ALLOCA:
+    builtin_alloca(node);
+    return;
+  case BI_UNREACHABLE:
+    printf("  ud2\n");
+    printf("  sub rsp, 8\n");
+    return;
+  case BI_MEMCPY:
+  case BI_MEMSET:
+    gen_expr(node->lhs);
+    gen_expr(node->rhs);
+    if (node->size) {
+      gen_expr(node->size);
+      printf("  pop rcx\n");
+    } else if (node->val > INLINE_MEM_MAX) {
+      printf("  mov rcx, %ld\n", node->val);
+    }
+
+    if (node->builtin == BI_MEMCPY) {
+      printf("  pop rsi\n");
+      printf("  pop rdi\n");
+    } else {
+      printf("  pop rax\n");
+      printf("  pop rdi\n");
+    }
+    printf("  push rdi\n"); // the destination is returned
+
+    if (node->builtin == BI_MEMCPY) {
+      if (node->size || node->val > INLINE_MEM_MAX)
+        printf("  rep movsb\n");
+      else
+        copy_bytes(node->val);
+      return;
+    }
+
+    if (node->size || node->val > INLINE_MEM_MAX) {
+      printf("  rep stosb\n");
+      return;
+    }
+    // broadcast the byte to all 8 bytes of rax
+    printf("  movzx eax, al\n");
+    printf("  movabs rdx, 0x0101010101010101\n");
+    printf("  imul rax, rdx\n");
+    fill_bytes(node->val);
+    return;
+  }
+}
+
+// stores xmm0 into the temporary that holds the value of a vector
+// expression, and pushes the address of it
+static void push_vector(Node *node) {
+  printf("  mov rax, rbp\n");
+  printf("  sub rax, %d\n", node->var->offset);
+  printf("  movups [rax], xmm0\n");
+  printf("  push rax\n");
+}
+
+// copies the scalar on the stack to every lane of a vector
+static void broadcast(Node *node) {
+  printf("  pop rax\n");
+  printf("  movq xmm0, rax\n");
+  switch (size_of(node->ty->base)) {
+  case 1:
+    printf("  punpcklbw xmm0, xmm0\n");
+  case 2:
+    printf("  punpcklwd xmm0, xmm0\n");
+  case 4:
+    printf("  pshufd xmm0, xmm0, 0\n");
+    break;
+  case 8:
+    printf("  punpcklqdq xmm0, xmm0\n");
+  }
+  push_vector(node);
+}
+
+// packed SSE2 instruction for an element-wise operation, if there is one
+static char *vector_insn(Node *node) {
+  Type *base = node->ty->base;
+  int sz = size_of(base);
+
+  if (is_flonum(base)) {
+    bool ps = base->kind == TY_FLOAT;
+    switch (node->kind) {
+    case ND_ADD: return ps ? "addps" : "addpd";
+    case ND_SUB: return ps ? "subps" : "subpd";
+    case ND_MUL: return ps ? "mulps" : "mulpd";
+    case ND_DIV: return ps ? "divps" : "divpd";
+    }
+    return NULL;
+  }
+
+  static char *padd[] = {"paddb", "paddw", NULL, "paddd", NULL, NULL, NULL, "paddq"};
+  static char *psub[] = {"psubb", "psubw", NULL, "psubd", NULL, NULL, NULL, "psubq"};
+
+  switch (node->kind) {
+  case ND_ADD: return padd[sz - 1];
+  case ND_SUB: return psub[sz - 1];
+  case ND_MUL: return sz == 2 ? "pmullw" : NULL;
+  case ND_BITAND: return "pand";
+  case ND_BITOR: return "por";
+  case ND_BITXOR: return "pxor";
+  }
+  return NULL;
+}
+
+// loads the lane at [addr+off] into register `idx`, extended to 64 bits
+static void load_lane(int idx, char *addr, int off, Type *ty) {
+  int sz = size_of(ty);
+  if (sz == 8)
+    printf("  mov %s, [%s+%d]\n", asm_reg64[idx], addr, off);
+  else if (sz == 4 && ty->is_unsigned)
+    printf("  mov %s, dword ptr [%s+%d]\n", asm_reg32[idx], addr, off);
+  else if (sz == 4)
+    printf("  movsxd %s, dword ptr [%s+%d]\n", asm_reg64[idx], addr, off);
+  else
+    printf("  %s %s, %s ptr [%s+%d]\n", ty->is_unsigned ? "movzx" : "movsx",
+           asm_reg64[idx], sz == 1 ? "byte" : "word", addr, off);
+}
+
+static void gen_vector_binary(Node *node) {
+  printf("# %s\n", "vector");
+  gen_expr(node->lhs);
+  gen_expr(node->rhs);
+  printf("  pop rdi\n"); // rhs
+  printf("  pop rsi\n"); // lhs
+
+  char *insn = vector_insn(node);
+  if (insn) {
+    printf("  movups xmm0, [rsi]\n");
+    printf("  movups xmm1, [rdi]\n");
+    printf("  %s xmm0, xmm1\n", insn);
+    push_vector(node);
+    return;
+  }
+
+  // SSE2 has no packed integer division, nor multiplication other than
+  // for 16-bit lanes: they are done one lane at a time
+  Type *base = node->ty->base;
+  int sz = size_of(base);
+
+  printf("  mov r8, rbp\n");
+  printf("  sub r8, %d\n", node->var->offset);
+  for (int i = 0; i < node->ty->array_len; i++) {
+    int off = i * sz;
+    load_lane(0, "rsi", off, base);
+    load_lane(1, "rdi", off, base);
+
+    if (node->kind == ND_MUL) {
+      printf("  imul rax, rcx\n");
+    } else {
+      if (base->is_unsigned) {
+        printf("  mov edx, 0\n");
+        printf("  div rcx\n");
+      } else {
+        printf("  cqo\n");
+        printf("  idiv rcx\n");
+      }
+      if (node->kind == ND_MOD)
+        printf("  mov rax, rdx\n");
+    }
+    printf("  mov [r8+%d], %s\n", off, sized_reg(0, sz));
+  }
+  printf("  push r8\n");
+}
+
 static void gen_expr(Node *node) {
-  printf(".loc %d %d\n", node->token->file_no, node->token->line_no);
+  printf(".loc %d %d\n", token_file(node->token)->file_no, node->token->line_no);
 
   switch (node->kind) {
   case ND_ASSIGN: {
@@ -419,6 +1105,13 @@ static void gen_expr(Node *node) {
   case ND_CAST:
     printf("# %s\n", "ND_CAST");
     gen_expr(node->lhs);
+    if (is_vector(node->ty)) {
+      if (!is_vector(node->lhs->ty)) {
+        cast(node->lhs->ty, node->ty->base);
+        broadcast(node);
+      }
+      return;
+    }
     cast(node->lhs->ty, node->ty);
     return;
   case ND_COND: {
@@ -448,6 +1141,14 @@ static void gen_expr(Node *node) {
   case ND_BITNOT:
     printf("# %s\n", "ND_BITNOT");
     gen_expr(node->lhs);
+    if (is_vector(node->ty)) {
+      printf("  pop rax\n");
+      printf("  movups xmm0, [rax]\n");
+      printf("  pcmpeqd xmm1, xmm1\n");
+      printf("  pxor xmm0, xmm1\n");
+      push_vector(node);
+      return;
+    }
     printf("  pop rax\n");
     printf("  not rax\n");
     printf("  push rax\n");
@@ -488,12 +1189,6 @@ static void gen_expr(Node *node) {
   }
   case ND_FUNCALL: {
     printf("# %s\n", "ND_FUNCALL");
-    if (node->lhs->kind == ND_VAR &&
-        !strcmp(node->lhs->var->name, "__builtin_va_start")) {
-      builtin_va_start(node);
-      return;
-    }
-
     // save caller-saved registers
     printf("  sub rsp, 64\n");
     printf("  mov [rsp], r10\n");
@@ -505,28 +1200,37 @@ static void gen_expr(Node *node) {
     printf("  movsd [rsp+48], xmm12\n");
     printf("  movsd [rsp+56], xmm13\n");
 
-    gen_expr(node->lhs);  // function address
-    printf("  pop r10\n");
+    // a named function is called directly, others through r10
+    Var *callee = NULL;
+    if (node->lhs->kind == ND_VAR && node->lhs->var->ty->kind == TY_FUNC)
+      callee = node->lhs->var;
+
+    if (!callee) {
+      gen_expr(node->lhs);  // function address
+      printf("  pop r10\n");
+    }
+
+    // reserve the outgoing area for stack-passed arguments, with rsp aligned
+    // to a 16-byte boundary, and keep the old rsp right above it
+    int stack = stack_args_size(node);
+    printf("  mov rax, rsp\n");
+    printf("  sub rsp, %d\n", stack + 8);
+    printf("  and rsp, -16\n");
+    printf("  mov [rsp+%d], rax\n", stack);
 
     // set arguments to ABI-specified registers, as well as number of floating ptr args to rax
     // NOTE: Do NOT use rax after this operation.
     // the compiler must preserve rax value untill the call is made.
     load_args(node);
 
-    // ensure rsp to be aligned to 16-bit boundary
-    int seq = labelseq++;
-    printf("  mov r11, rsp\n");
-    printf("  and r11, 15\n");
-    printf("  jne .L.unaligned.%d\n", seq);
-
     // invoke call
-    printf("  call r10\n");
-    printf("  jmp .L.end.%d\n", seq);
-    printf(".L.unaligned.%d:\n", seq);
-    printf("  sub rsp, 8\n");
-    printf("  call r10\n");
-    printf("  add rsp, 8\n");
-    printf(".L.end.%d:\n", seq);
+    if (!callee)
+      printf("  call r10\n");
+    else if (is_local_symbol(callee))
+      printf("  call %s\n", callee->name);
+    else
+      printf("  call %s@PLT\n", callee->name);
+    printf("  mov rsp, [rsp+%d]\n", stack);
 
     // restore caller-saved registers
     printf("  mov r10, [rsp]\n");
@@ -545,7 +1249,26 @@ static void gen_expr(Node *node) {
     if (node->ty->kind == TY_BOOL)
       printf("  movzx rax, al\n");
 
-    if (is_flonum(node->ty))
+    // a returned struct is pushed as the address of its buffer (in the
+    // callee's case, rax holds it already)
+    if (node->ty->kind == TY_STRUCT) {
+      if (!in_memory(node->ty)) {
+        int gp = 0, fp = 0;
+        for (int part = 0; part * 8 < size_of(node->ty); part++) {
+          if (is_sse_part(node->ty, part))
+            store_part(node->ty, part, fp++, "rbp", -node->var->offset);
+          else
+            store_part(node->ty, part, gp++ ? 2 : 0, "rbp", -node->var->offset);
+        }
+      }
+      printf("  lea rax, [rbp-%d]\n", node->var->offset);
+      printf("  push rax\n");
+      return;
+    }
+
+    if (is_vector(node->ty))
+      push_vector(node);
+    else if (is_flonum(node->ty))
       push_from("xmm0", node->ty);
     else
       push_from("rax", node->ty);
@@ -585,6 +1308,66 @@ static void gen_expr(Node *node) {
     printf("# %s\n", "ND_NULL_EXPR");
     printf("  sub rsp, 8\n");
     return;
+  case ND_LABEL_VAL:
+    printf("# %s\n", "ND_LABEL_VAL");
+    printf("  lea rax, .L.label.%s.%s[rip]\n", current_fn->name, node->label_name);
+    printf("  push rax\n");
+    return;
+  case ND_CAS: {
+    printf("# %s\n", "ND_CAS");
+    gen_expr(node->cas_addr);
+    gen_expr(node->cas_old);
+    gen_expr(node->cas_new);
+
+    int sz = size_of(node->cas_addr->ty->base);
+    int seq = labelseq++;
+    printf("  pop rdx\n"); // desired value
+    printf("  pop rsi\n"); // address of the expected value
+    printf("  pop rdi\n"); // address
+    printf("  mov %s, [rsi]\n", sized_reg(0, sz));
+    printf("  lock cmpxchg [rdi], %s\n", sized_reg(2, sz));
+    printf("  sete cl\n");
+    printf("  je .L.cas.%d\n", seq);
+    // on failure, the current value is written back to *expected
+    printf("  mov [rsi], %s\n", sized_reg(0, sz));
+    printf(".L.cas.%d:\n", seq);
+    printf("  movzx eax, cl\n");
+    printf("  push rax\n");
+    return;
+  }
+  case ND_EXCH:
+  case ND_FETCH_ADD:
+    printf("# %s\n", node->kind == ND_EXCH ? "ND_EXCH" : "ND_FETCH_ADD");
+    gen_expr(node->lhs);
+    gen_expr(node->rhs);
+    printf("  pop rax\n");
+    printf("  pop rdi\n");
+    if (node->kind == ND_EXCH)
+      printf("  xchg [rdi], %s\n", sized_reg(0, size_of(node->ty)));
+    else
+      printf("  lock xadd [rdi], %s\n", sized_reg(0, size_of(node->ty)));
+    extend_rax(node->ty);
+    printf("  push rax\n");
+    return;
+  case ND_BUILTIN:
+    printf("# %s\n", "ND_BUILTIN");
+    gen_builtin(node);
+    return;
+  case ND_FENCE:
+    printf("# %s\n", "ND_FENCE");
+    printf("  mfence\n");
+    printf("  sub rsp, 8\n");
+    return;
+  case ND_MEMZERO:
+    printf("# %s\n", "ND_MEMZERO");
+    memzero(node->var);
+    printf("  sub rsp, 8\n");
+    return;
+  }
+
+  if (is_vector(node->ty)) {
+    gen_vector_binary(node);
+    return;
   }
 
   char *rs64 = reg(node->lhs->ty, 1, true);
@@ -747,14 +1530,384 @@ static void gen_expr(Node *node) {
   }
 }
 
+// returns the register number of a clobber such as "ebx" or "%rbx" (-1 if none)
+static int asm_reg_index(char *name) {
+  if (*name == '%')
+    name++;
+
+  for (int i = 0; i < 16; i++)
+    if (!strcmp(name, asm_reg8[i]) || !strcmp(name, asm_reg16[i]) ||
+        !strcmp(name, asm_reg32[i]) || !strcmp(name, asm_reg64[i]))
+      return i;
+  for (int i = 0; i < 4; i++)
+    if (!strcmp(name, asm_reg8h[i]))
+      return i;
+  return -1;
+}
+
+// assigns registers to operands: specific ones first, then any free
+// caller-saved register, and finally matching constraints.
+// returns true if rbx (callee-saved, and not preserved by the prologue)
+// has to be saved around the asm
+static bool asm_alloc_regs(Node *node, AsmOperand **ops, int nops) {
+  static int gp_pool[] = {8, 9, 10, 11, 6, 7, 1, 2, 0};
+  bool used[16] = {};
+  bool xmm_used[16] = {};
+  used[4] = used[5] = true; // rsp, rbp
+
+  for (char **c = node->asm_clobbers; c && *c; c++) {
+    int idx = asm_reg_index(*c);
+    if (idx >= 0)
+      used[idx] = true;
+    else if (!strncmp(*c, "xmm", 3) || !strncmp(*c, "%xmm", 4)) {
+      // xmm16-31 need AVX-512, which operands are never given
+      int n = atoi(strchr(*c, 'm') + 2);
+      if (n < 0 || n > 15)
+        error_tok(node->token, "invalid clobber '%s'", *c);
+      xmm_used[n] = true;
+    }
+  }
+  bool save_rbx = used[REG_RBX];
+
+  // "a", "c", "d" and "b" in encoding order
+  char *letters = "acdb";
+  for (int i = 0; i < nops; i++) {
+    char *p = strchr(letters, ops[i]->kind);
+    if (p && ops[i]->match < 0) {
+      ops[i]->reg = p - letters;
+      used[ops[i]->reg] = true;
+    } else if (ops[i]->kind == 'S' && ops[i]->match < 0) {
+      used[ops[i]->reg = 6] = true;
+    } else if (ops[i]->kind == 'D' && ops[i]->match < 0) {
+      used[ops[i]->reg = 7] = true;
+    }
+  }
+
+  for (int i = 0; i < nops; i++) {
+    AsmOperand *op = ops[i];
+    if (op->match >= 0)
+      continue;
+
+    if (op->kind == 'r' || op->kind == 'm') {
+      int j = 0;
+      while (j < sizeof(gp_pool) / sizeof(*gp_pool) && used[gp_pool[j]])
+        j++;
+      if (j == sizeof(gp_pool) / sizeof(*gp_pool))
+        error_tok(node->token, "asm: out of registers");
+      used[op->reg = gp_pool[j]] = true;
+    } else if (op->kind == 'x') {
+      int j = 0;
+      while (j < 16 && xmm_used[j])
+        j++;
+      if (j == 16)
+        error_tok(node->token, "asm: out of registers");
+      xmm_used[op->reg = j] = true;
+    }
+  }
+
+  for (int i = 0; i < nops; i++) {
+    if (ops[i]->match >= 0)
+      ops[i]->reg = ops[ops[i]->match]->reg;
+    if (ops[i]->kind != 'x' && ops[i]->kind != 'i' && ops[i]->reg == REG_RBX)
+      save_rbx = true;
+  }
+  return save_rbx;
+}
+
+// loads an operand into its register (Intel syntax)
+static void asm_load(AsmOperand *op) {
+  if (op->kind == 'm') {
+    printf("  mov %s, [rbp-%d]\n", asm_reg64[op->reg], op->ptr->offset);
+    return;
+  }
+  if (op->kind == 'i' || !op->val)
+    return;
+
+  Type *ty = op->val->ty;
+  int offset = op->val->offset;
+
+  if (op->kind == 'x') {
+    if (ty->kind == TY_FLOAT)
+      printf("  movss xmm%d, DWORD PTR [rbp-%d]\n", op->reg, offset);
+    else if (ty->kind == TY_DOUBLE)
+      printf("  movsd xmm%d, QWORD PTR [rbp-%d]\n", op->reg, offset);
+    else if (size_of(ty) == 4)
+      printf("  movd xmm%d, DWORD PTR [rbp-%d]\n", op->reg, offset);
+    else
+      printf("  movq xmm%d, QWORD PTR [rbp-%d]\n", op->reg, offset);
+    return;
+  }
+
+  char *insn = ty->is_unsigned ? "movzx" : "movsx";
+  switch (size_of(ty)) {
+  case 1:
+    printf("  %s %s, BYTE PTR [rbp-%d]\n", insn, asm_reg64[op->reg], offset);
+    return;
+  case 2:
+    printf("  %s %s, WORD PTR [rbp-%d]\n", insn, asm_reg64[op->reg], offset);
+    return;
+  case 4:
+    if (ty->is_unsigned || is_flonum(ty))
+      printf("  mov %s, DWORD PTR [rbp-%d]\n", asm_reg32[op->reg], offset);
+    else
+      printf("  movsxd %s, DWORD PTR [rbp-%d]\n", asm_reg64[op->reg], offset);
+    return;
+  default:
+    printf("  mov %s, QWORD PTR [rbp-%d]\n", asm_reg64[op->reg], offset);
+  }
+}
+
+// prints an operand in AT&T syntax, with an optional size modifier
+// (b, h, w, k, q) or c/P for a bare constant
+static void asm_print_operand(Node *node, AsmOperand *op, char modifier) {
+  switch (op->kind) {
+  case 'i':
+    printf(modifier == 'c' || modifier == 'P' ? "%ld" : "$%ld", op->imm);
+    return;
+  case 'x':
+    printf("%%xmm%d", op->reg);
+    return;
+  case 'm':
+    printf("(%%%s)", asm_reg64[op->reg]);
+    return;
+  }
+
+  int sz = size_of(op->ty);
+  switch (modifier) {
+  case 'b': sz = 1; break;
+  case 'w': sz = 2; break;
+  case 'k': sz = 4; break;
+  case 'q': sz = 8; break;
+  case 'h':
+    if (op->reg >= 4)
+      error_tok(node->token, "asm: %%h is only valid for a, b, c and d registers");
+    printf("%%%s", asm_reg8h[op->reg]);
+    return;
+  }
+
+  if (sz == 1)
+    printf("%%%s", asm_reg8[op->reg]);
+  else if (sz == 2)
+    printf("%%%s", asm_reg16[op->reg]);
+  else if (sz == 4)
+    printf("%%%s", asm_reg32[op->reg]);
+  else
+    printf("%%%s", asm_reg64[op->reg]);
+}
+
+// prints an extended asm template, substituting %N, %[name], %% and %=
+static void asm_print_template(Node *node, AsmOperand **ops, int nops, int seq) {
+  printf("  ");
+
+  for (char *p = node->asm_str; *p; p++) {
+    if (*p != '%') {
+      printf("%c", *p);
+      continue;
+    }
+
+    p++;
+    if (*p == '%') {
+      printf("%%");
+      continue;
+    }
+    if (*p == '=') {
+      printf("%d", seq);
+      continue;
+    }
+
+    char modifier = 0;
+    if (isalpha(*p))
+      modifier = *p++;
+
+    int idx = -1;
+    if (isdigit(*p)) {
+      idx = strtol(p, &p, 10);
+      p--;
+    } else if (*p == '[') {
+      char *end = strchr(p, ']');
+      if (!end)
+        error_tok(node->token, "asm: unterminated operand name");
+      for (int i = 0; i < nops; i++)
+        if (ops[i]->name && strlen(ops[i]->name) == end - p - 1 &&
+            !strncmp(ops[i]->name, p + 1, end - p - 1))
+          idx = i;
+      p = end;
+    }
+
+    if (idx < 0 || idx >= nops)
+      error_tok(node->token, "asm: invalid operand reference");
+    asm_print_operand(node, ops[idx], modifier);
+  }
+  printf("\n");
+}
+
+// inline assembly. the template is emitted in AT&T syntax as GNU C expects;
+// operands are moved between their frame temporaries and registers around it.
+static void gen_asm(Node *node) {
+  if (node->lhs) {
+    gen_expr(node->lhs);
+    printf("  add rsp, 8\n");
+  }
+
+  if (node->asm_is_basic) {
+    printf("  .att_syntax\n");
+    printf("  %s\n", node->asm_str);
+    printf("  .intel_syntax noprefix\n");
+    return;
+  }
+
+  AsmOperand *ops[30];
+  int nops = 0;
+  for (AsmOperand *op = node->asm_ops; op; op = op->next)
+    ops[nops++] = op;
+
+  bool save_rbx = asm_alloc_regs(node, ops, nops);
+  if (save_rbx)
+    printf("  push rbx\n");
+
+  for (int i = 0; i < nops; i++)
+    asm_load(ops[i]);
+
+  printf("  .att_syntax\n");
+  asm_print_template(node, ops, nops, labelseq++);
+  printf("  .intel_syntax noprefix\n");
+
+  // save register outputs first, as storing one needs scratch registers
+  int nout = 0;
+  for (; nout < nops && ops[nout]->is_output; nout++) {
+    AsmOperand *op = ops[nout];
+    if (op->kind == 'x') {
+      printf("  sub rsp, 8\n");
+      printf("  movq QWORD PTR [rsp], xmm%d\n", op->reg);
+    } else if (op->kind != 'm') {
+      printf("  push %s\n", asm_reg64[op->reg]);
+    }
+  }
+
+  for (int i = nout - 1; i >= 0; i--) {
+    AsmOperand *op = ops[i];
+    if (op->kind == 'm')
+      continue;
+
+    printf("  pop rax\n");
+    printf("  mov rdi, [rbp-%d]\n", op->ptr->offset);
+    switch (size_of(op->ty)) {
+    case 1:
+      printf("  mov [rdi], al\n");
+      break;
+    case 2:
+      printf("  mov [rdi], ax\n");
+      break;
+    case 4:
+      printf("  mov [rdi], eax\n");
+      break;
+    default:
+      printf("  mov [rdi], rax\n");
+    }
+  }
+
+  if (save_rbx)
+    printf("  pop rbx\n");
+}
+
+// true if `node` unconditionally calls a function declared cold
+static bool calls_cold_fn(Node *node) {
+  if (!node)
+    return false;
+
+  switch (node->kind) {
+  case ND_BLOCK:
+    for (Node *n = node->body; n; n = n->next)
+      if (calls_cold_fn(n))
+        return true;
+    return false;
+  case ND_EXPR_STMT:
+  case ND_RETURN:
+  case ND_CAST:
+    return calls_cold_fn(node->lhs);
+  case ND_COMMA:
+    // a call is the rhs of its argument assignments
+    return calls_cold_fn(node->rhs);
+  case ND_FUNCALL:
+    return node->lhs->kind == ND_VAR && node->lhs->var->is_cold;
+  default:
+    return false;
+  }
+}
+
+// decides which arm of an if statement is unlikely to run:
+// 1 for "then", -1 for "else" and 0 when there is no hint
+static int cold_branch(Node *node) {
+  Node *cond = node->cond;
+  while (cond->kind == ND_CAST)
+    cond = cond->lhs;
+
+  if (cond->kind == ND_BUILTIN && cond->builtin == BI_EXPECT) {
+    if (cond->val == 0)
+      return 1;
+    return node->els ? -1 : 0;
+  }
+
+  if (calls_cold_fn(node->then))
+    return 1;
+  if (calls_cold_fn(node->els))
+    return -1;
+  return 0;
+}
+
+static void defer_cold(Node *stmt, int seq) {
+  ColdBlock *blk = calloc(1, sizeof(ColdBlock));
+  blk->stmt = stmt;
+  blk->seq = seq;
+  blk->brkseq = brkseq;
+  blk->contseq = contseq;
+  blk->next = cold_blocks;
+  cold_blocks = blk;
+}
+
+// emits the queued unlikely arms, each of which jumps back to the end of its
+// if statement. an arm may queue further ones while being generated
+static void emit_cold_blocks(void) {
+  if (!cold_blocks)
+    return;
+
+  printf(".section .text.unlikely,\"ax\",@progbits\n");
+  while (cold_blocks) {
+    ColdBlock *blk = cold_blocks;
+    cold_blocks = blk->next;
+
+    brkseq = blk->brkseq;
+    contseq = blk->contseq;
+    printf(".L.cold.%d:\n", blk->seq);
+    gen_stmt(blk->stmt);
+    printf("  jmp .L.end.%d\n", blk->seq);
+  }
+  brkseq = contseq = 0;
+  printf(".text\n");
+}
+
 static void gen_stmt(Node *node) {
-  printf(".loc %d %d\n", node->token->file_no, node->token->line_no);
+  printf(".loc %d %d\n", token_file(node->token)->file_no, node->token->line_no);
 
   switch (node->kind) {
   case ND_IF: {
     printf("# %s\n", "ND_IF");
     int seq = labelseq++;
 
+    int cold = cold_branch(node);
+    if (cold) {
+      // jump out to the unlikely arm; the likely one falls through
+      gen_expr(node->cond);
+      cmp_zero(node->cond->ty);
+      printf("  %s .L.cold.%d\n", cold > 0 ? "jne" : "je", seq);
+      Node *hot = cold > 0 ? node->els : node->then;
+      if (hot)
+        gen_stmt(hot);
+      printf(".L.end.%d:\n", seq);
+      defer_cold(cold > 0 ? node->then : node->els, seq);
+      return;
+    }
+
     if (node->els) {
       gen_expr(node->cond);
       cmp_zero(node->cond->ty);
@@ -782,6 +1935,8 @@ static void gen_stmt(Node *node) {
 
     if (node->init)
       gen_stmt(node->init);
+    if (node->var)
+      save_vla(node->var);
     printf(".L.begin.%d:\n", seq);
     if (node->cond) {
       gen_expr(node->cond);
@@ -790,10 +1945,14 @@ static void gen_stmt(Node *node) {
     }
     gen_stmt(node->then);
     printf(".L.continue.%d:\n", seq);
+    if (node->var)
+      dealloc_vla(node->var);
     if (node->inc)
       gen_stmt(node->inc);
     printf("  jmp .L.begin.%d\n", seq);
     printf(".L.break.%d:\n", seq);
+    if (node->var)
+      dealloc_vla(node->var);
 
     brkseq = prevbrk;
     contseq = prevcont;
@@ -806,13 +1965,19 @@ static void gen_stmt(Node *node) {
     int cont = contseq;
     brkseq = contseq = seq;
 
+    if (node->var)
+      save_vla(node->var);
     printf(".L.begin.%d:\n", seq);
     gen_stmt(node->then);
     printf(".L.continue.%d:\n", seq);
+    if (node->var)
+      dealloc_vla(node->var);
     gen_expr(node->cond);
     cmp_zero(node->cond->ty);
     printf("  jne .L.begin.%d\n", seq);
     printf(".L.break.%d:\n", seq);
+    if (node->var)
+      dealloc_vla(node->var);
 
     brkseq = brk;
     contseq = cont;
@@ -825,6 +1990,8 @@ static void gen_stmt(Node *node) {
     brkseq = seq;
     node->case_label = seq;
 
+    if (node->var)
+      save_vla(node->var);
     gen_expr(node->cond);
     printf("  pop rax\n");
 
@@ -845,6 +2012,8 @@ static void gen_stmt(Node *node) {
     printf("  jmp .L.break.%d\n", seq);
     gen_stmt(node->then);
     printf(".L.break.%d:\n", seq);
+    if (node->var)
+      dealloc_vla(node->var);
 
     brkseq = prevbrk;
     return;
@@ -870,6 +2039,16 @@ static void gen_stmt(Node *node) {
     printf("# %s\n", "ND_GOTO");
     printf("  jmp .L.label.%s.%s\n", current_fn->name, node->label_name);
     return;
+  case ND_ASM:
+    printf("# %s\n", "ND_ASM");
+    gen_asm(node);
+    return;
+  case ND_GOTO_EXPR:
+    printf("# %s\n", "ND_GOTO_EXPR");
+    gen_expr(node->lhs);
+    printf("  pop rax\n");
+    printf("  jmp rax\n");
+    return;
   case ND_LABEL:
     printf("# %s\n", "ND_LABEL");
     printf(".L.label.%s.%s:\n", current_fn->name, node->label_name);
@@ -877,9 +2056,31 @@ static void gen_stmt(Node *node) {
     return;
   case ND_RETURN:
     printf("# %s\n", "ND_RETURN");
-    if (node->lhs) {
+    if (node->lhs && node->lhs->ty->kind == TY_STRUCT) {
+      Type *ty = node->lhs->ty;
       gen_expr(node->lhs);
-      if (is_flonum(node->lhs->ty))
+      printf("  pop rsi\n");
+      if (current_fn->struct_ret) {
+        // copy to the caller's buffer, and return its address
+        printf("  mov rdi, [rbp-%d]\n", current_fn->struct_ret->offset);
+        copy_bytes(size_of(ty));
+        printf("  mov rax, rdi\n");
+      } else {
+        // in rax and rdx, or xmm0 and xmm1, one register per eightbyte
+        int gp = 0, fp = 0;
+        for (int part = 0; part * 8 < size_of(ty); part++) {
+          if (is_sse_part(ty, part))
+            load_part(ty, part, fp++, "rsi", 0);
+          else
+            load_part(ty, part, gp++ ? 2 : 0, "rsi", 0);
+        }
+      }
+    } else if (node->lhs) {
+      gen_expr(node->lhs);
+      if (is_vector(node->lhs->ty)) {
+        printf("  pop rax\n");
+        printf("  movups xmm0, [rax]\n");
+      } else if (is_flonum(node->lhs->ty))
         pop_to("xmm0", node->lhs->ty);
       else
         pop_to("rax", node->lhs->ty);
@@ -893,6 +2094,9 @@ static void gen_stmt(Node *node) {
       gen_stmt(stmt);
       stmt = stmt->next;
     }
+    // the block declares VLAs (and saved the bottom before the first one)
+    if (node->var)
+      dealloc_vla(node->var);
     return;
   }
   case ND_EXPR_STMT:
@@ -905,17 +2109,114 @@ static void gen_stmt(Node *node) {
   }
 }
 
+// mark functions and global vars that are reachable from non-static symbols.
+// static ones left unmarked are never referenced, so they need not be emitted.
+static void mark_fn(Function *fn);
+
+static void mark_var(Var *var) {
+  if (var->is_local || var->is_live)
+    return;
+  var->is_live = true;
+
+  if (var->fn)
+    mark_fn(var->fn);
+  for (Relocation *rel = var->rel; rel; rel = rel->next)
+    mark_var(rel->var);
+}
+
+static void mark_node(Node *node) {
+  if (!node)
+    return;
+
+  if (node->kind == ND_VAR)
+    mark_var(node->var);
+
+  mark_node(node->lhs);
+  mark_node(node->rhs);
+  mark_node(node->cond);
+  mark_node(node->then);
+  mark_node(node->els);
+  mark_node(node->init);
+  mark_node(node->inc);
+  mark_node(node->size);
+  mark_node(node->cas_addr);
+  mark_node(node->cas_old);
+  mark_node(node->cas_new);
+
+  for (Node *n = node->body; n; n = n->next)
+    mark_node(n);
+}
+
+static void mark_fn(Function *fn) {
+  if (fn->is_live)
+    return;
+  fn->is_live = true;
+
+  for (Node *n = fn->node; n; n = n->next)
+    mark_node(n);
+}
+
+static void mark_live_symbols(Program *prog) {
+  for (Function *fn = prog->fns; fn; fn = fn->next)
+    if (!fn->is_static)
+      mark_fn(fn);
+
+  for (Var *var = prog->globals; var; var = var->next)
+    if (!var->is_static)
+      mark_var(var);
+
+  if (!opt_stats)
+    return;
+
+  int nfns = 0, nvars = 0;
+  for (Function *fn = prog->fns; fn; fn = fn->next)
+    if (!fn->is_live)
+      nfns++;
+  for (Var *var = prog->globals; var; var = var->next)
+    if (!var->is_live)
+      nvars++;
+
+  fprintf(stderr, "removed %d unreferenced static function(s), %d static variable(s)\n",
+          nfns, nvars);
+}
+
+static void emit_label(Var *var) {
+  printf(".align %d\n", var->align);
+  if (!var->is_static)
+    printf(".globl %s\n", var->name);
+  // a shared library's data needs a type and a size, for copy relocations
+  printf(".type %s, @%s\n", var->name, var->is_tls ? "tls_object" : "object");
+  printf(".size %s, %d\n", var->name, size_of(var->ty));
+  printf("%s:\n", var->name);
+}
+
+static void emit_init_data(Var *var) {
+  Relocation *rel = var->rel;
+  Incbin *inc = var->incbin;
+  int pos = 0;
+  while (pos < size_of(var->ty)) {
+    if (inc && inc->offset == pos) {
+      printf("  .incbin %s, 0, %d\n", quote_string(inc->path), inc->len);
+      pos += inc->len;
+      inc = inc->next;
+    } else if (rel && rel->offset == pos) {
+      printf("  .quad %s%+ld\n", rel->var->name, rel->addend);
+      rel = rel->next;
+      pos += 8;
+    } else {
+      printf("  .byte %d\n", var->init_data[pos++]);
+    }
+  }
+}
+
 static void emit_bss(Program *prog) {
   printf(".bss\n");
 
   for (Var *var = prog->globals; var; var = var->next) {
-    if (var->init_data)
+    if (var->init_data || !var->is_live || var->is_tls)
       continue;
 
-    printf(".align %d\n", var->align);
-    if (!var->is_static)
-      printf(".globl %s\n", var->name);
-    printf("%s:\n", var->name);
+    emit_label(var);
     printf("  .zero %d\n", size_of(var->ty));
   }
 }
@@ -924,24 +2225,28 @@ static void emit_data(Program *prog) {
   printf(".data\n");
 
   for (Var *var = prog->globals; var; var = var->next) {
-    if (!var->init_data)
+    if (!var->init_data || !var->is_live || var->is_tls)
       continue;
 
-    printf(".align %d\n", var->align);
-    if (!var->is_static)
-      printf(".globl %s\n", var->name);
-    printf("%s:\n", var->name);
-
-    Relocation *rel = var->rel;
-    int pos = 0;
-    while (pos < size_of(var->ty)) {
-      if (rel && rel->offset == pos) {
-        printf("  .quad %s%+ld\n", rel->label, rel->addend);
-        rel = rel->next;
-        pos += 8;
-      } else {
-        printf("  .byte %d\n", var->init_data[pos++]);
-      }
+    emit_label(var);
+    emit_init_data(var);
+  }
+}
+
+// thread-local variables. each thread gets a copy of .tdata/.tbss
+static void emit_tls(Program *prog) {
+  for (Var *var = prog->globals; var; var = var->next) {
+    if (!var->is_tls || !var->is_live)
+      continue;
+
+    if (var->init_data) {
+      printf(".section .tdata,\"awT\",@progbits\n");
+      emit_label(var);
+      emit_init_data(var);
+    } else {
+      printf(".section .tbss,\"awT\",@nobits\n");
+      emit_label(var);
+      printf("  .zero %d\n", size_of(var->ty));
     }
   }
 }
@@ -950,17 +2255,26 @@ static void emit_text(Program *prog) {
   printf(".text\n");
 
   for(Function *fn = prog->fns; fn; fn = fn->next) {
+    if (!fn->is_live)
+      continue;
     current_fn = fn;
 
+    if (fn->is_cold)
+      printf(".section .text.unlikely,\"ax\",@progbits\n");
+
     // label of the function
     if (!fn->is_static)
       printf(".globl %s\n", fn->name);
+    printf(".type %s, @function\n", fn->name);
     printf("%s:\n", fn->name);
 
     // prologue
     printf("  push rbp\n");
     printf("  mov rbp, rsp\n");
     printf("  sub rsp, %d\n", fn->stack_size);
+    // dynamic allocations start right below the fixed-size frame
+    if (fn->alloca_bottom)
+      printf("  mov [rbp-%d], rsp\n", fn->alloca_bottom->offset);
     // preserve callee-saved registers
     printf("  mov [rbp-8], r12\n");
     printf("  mov [rbp-16], r13\n");
@@ -969,21 +2283,17 @@ static void emit_text(Program *prog) {
 
     // save arg registers if function is variadic
     if (fn->is_variadic) {
-      printf("  mov [rbp-128], rdi\n");
-      printf("  mov [rbp-120], rsi\n");
-      printf("  mov [rbp-112], rdx\n");
-      printf("  mov [rbp-104], rcx\n");
-      printf("  mov [rbp-96], r8\n");
-      printf("  mov [rbp-88], r9\n");
-      printf("  movsd [rbp-80], xmm0\n");
-      printf("  movsd [rbp-72], xmm1\n");
-      printf("  movsd [rbp-64], xmm2\n");
-      printf("  movsd [rbp-56], xmm3\n");
-      printf("  movsd [rbp-48], xmm4\n");
-      printf("  movsd [rbp-40], xmm5\n");
-    }
-
-    store_args(fn->params);
+      printf("  mov [rbp-208], rdi\n");
+      printf("  mov [rbp-200], rsi\n");
+      printf("  mov [rbp-192], rdx\n");
+      printf("  mov [rbp-184], rcx\n");
+      printf("  mov [rbp-176], r8\n");
+      printf("  mov [rbp-168], r9\n");
+      for (int i = 0; i < 8; i++)
+        printf("  movsd [rbp-%d], xmm%d\n", 160 - i * 16, i);
+    }
+
+    store_args(fn);
 
     for (Node *n = fn->node; n; n = n->next)
       gen_stmt(n);
@@ -999,13 +2309,23 @@ static void emit_text(Program *prog) {
     printf("  pop rbp\n");
 
     printf("  ret\n");
+    printf(".size %s, .-%s\n", fn->name, fn->name);
+
+    emit_cold_blocks();
+    if (fn->is_cold)
+      printf(".text\n");
   }
 }
 
 void codegen(Program *prog) {
   printf(".intel_syntax noprefix\n");
 
+  mark_live_symbols(prog);
   emit_bss(prog);
   emit_data(prog);
+  emit_tls(prog);
   emit_text(prog);
+
+  // the stack need not be executable (which would otherwise be assumed)
+  printf(".section .note.GNU-stack,\"\",@progbits\n");
 }
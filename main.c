@@ -1,11 +1,15 @@
 #include "alloycc.h"
 
 bool opt_E;
+bool opt_stats;
+bool opt_fpic;
+bool opt_fpie;
 char **include_paths;
 static char *input_file;
+static bool opt_bench_lex;
 
 static void usage(void) {
-  fprintf(stderr, "alloycc [ -I<path> ] <file>\n");
+  fprintf(stderr, "alloycc [ -I<path> ] [ -E ] [ -fPIC | -fPIE ] [ --stats ] [ --bench-lex ] <file>\n");
   exit(1);
 }
 
@@ -27,6 +31,26 @@ static void parse_args(int argc, char **argv) {
       continue;
     }
 
+    if (!strcmp(argv[i], "-fPIC") || !strcmp(argv[i], "-fpic")) {
+      opt_fpic = true;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-fPIE") || !strcmp(argv[i], "-fpie")) {
+      opt_fpie = true;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "--stats")) {
+      opt_stats = true;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "--bench-lex")) {
+      opt_bench_lex = true;
+      continue;
+    }
+
     if (argv[i][0] == '-' && argv[i][1] != '\0')
       error("unknown argument: %s", argv[i]);
 
@@ -43,6 +67,8 @@ static void print_tokens(Token *tok) {
   int line = 1;
 
   for (; tok->kind != TK_EOF; tok = tok->next) {
+    if (tok->kind == TK_EMBED)
+      expand_embed(tok);
     if (line > 1 && tok->at_bol)
       printf("\n");
     if (tok->has_space && !tok->at_bol)
@@ -58,6 +84,11 @@ int main(int argc, char **argv) {
 
   parse_args(argc, argv);
 
+  if (opt_bench_lex) {
+    bench_lex(input_file);
+    return 0;
+  }
+
   Token *tok = tokenize_file(input_file);
   if (!tok)
     error("%s: %s", input_file, strerror(errno));
@@ -72,8 +103,9 @@ int main(int argc, char **argv) {
 
   for (Function *fn = prog->fns; fn; fn = fn->next) {
     // first 32 bytes are reserved for callee saved resigisters
-    // additional 96 bytes can be used for variadic vars (if requried)
-    int offset = fn->is_variadic? 128 : 32;
+    // additional 176 bytes can be used for variadic vars (if requried):
+    // the register save area of 6 general-purpose and 8 xmm registers
+    int offset = fn->is_variadic? 208 : 32;
 
     for (Var *var = fn->locals; var; var = var->next) {
       offset = align_to(offset, var->align);
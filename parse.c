@@ -23,6 +23,9 @@ typedef struct {
   bool is_typedef;
   bool is_static;
   bool is_extern;
+  bool is_tls;
+  bool is_cold;     // __attribute__((cold))
+  int vector_size;  // __attribute__((vector_size(n)))
   int align;
 } VarAttr;
 
@@ -74,11 +77,28 @@ static int scope_depth;
 
 // Points to the function object the parser is currently parsing.
 static Var *current_fn;
+// Labeled statements of the current function, and the "&&" operands
+// that must name one of them.
+static Node *labels;
+static Node *label_vals;
 // Points to a node representing a switch if we are parsing
 // a switch statement. Otherwise, NULL.
 static Node *current_switch;
 
+// alloca and VLAs of the current function: the frame slot that holds the
+// bottom of the dynamically allocated area, and the slot to which the
+// innermost block saves it before its first VLA (to be restored on exit)
+static Var *alloca_bottom;
+static Var *vla_save;
+// number of VLAs declared so far, to tell whether a loop body has any
+static int vla_count;
+
 static bool is_typename(Token *tok);
+static bool is_const_expr(Node *node);
+static bool is_variably_modified(Type *ty);
+static Node *new_alloca(Node *sz);
+static Token *attribute_list(Token *tok, VarAttr *attr);
+static Type *declarator_attributes(Token **rest, Token *tok, Type *ty);
 static Type *typespec(Token **rest, Token *tok, VarAttr *attr);
 static Type *typename(Token **rest, Token *tok);
 static void register_enum_list(Token **rest, Token *tok, Type *ty);
@@ -104,6 +124,7 @@ static Node *do_stmt(Token **rest, Token *tok);
 static Node *for_stmt(Token **rest, Token *tok);
 
 static Node *goto_stmt(Token **rest, Token *tok);
+static Node *asm_stmt(Token **rest, Token *tok);
 static Node *switch_stmt(Token **rest, Token *tok);
 static Node *case_labeled_stmt(Token **rest, Token *tok);
 static Node *default_labeled_stmt(Token **rest, Token *tok);
@@ -215,19 +236,29 @@ static Initializer *new_init(Type *ty, int len, Node *expr, Token *tok) {
   return init;
 }
 
-static Var *new_lvar(char *name, Type *ty) {
-  Var *var = new_var(name, ty);
+static Var *add_lvar(Var *var) {
   var->is_local = true;
   var->next = locals;
   locals = var;
-  push_scope(name)->var = var;
+  push_scope(var->name)->var = var;
   return var;
 }
 
+static Var *new_lvar(char *name, Type *ty) {
+  return add_lvar(new_var(name, ty));
+}
+
+static Var *get_alloca_bottom(void) {
+  if (!alloca_bottom)
+    alloca_bottom = new_lvar("", pointer_to(ty_char));
+  return alloca_bottom;
+}
+
 static Var *new_gvar(char *name, Type *ty, bool is_static, bool emit) {
   Var *var = new_var(name, ty);
   var->is_local = false;
   var->is_static = is_static;
+  var->is_definition = emit;
   if (emit) {
     var->next = globals;
     globals = var;
@@ -236,18 +267,32 @@ static Var *new_gvar(char *name, Type *ty, bool is_static, bool emit) {
   return var;
 }
 
-// finds a variable or a typedef by name
+// finds a variable or a typedef by its interned name
 static VarScope *lookup_var(char *name) {
   for (VarScope *sc = var_scope; sc; sc = sc->next) {
-    if (!strcmp(sc->name, name))
+    if (sc->name == name)
       return sc;
   }
   return NULL;
 }
 
+// all declarations of a function share one symbol, so that references
+// made before its definition can be resolved to the function body
+static Var *new_func_var(char *name, Type *ty, VarAttr *attr) {
+  VarScope *sc = lookup_var(name);
+  if (sc && sc->depth == 0 && sc->var && sc->var->ty->kind == TY_FUNC) {
+    sc->var->is_static |= attr->is_static;
+    sc->var->is_cold |= attr->is_cold;
+    return sc->var;
+  }
+  Var *var = new_gvar(name, ty, attr->is_static, false);
+  var->is_cold = attr->is_cold;
+  return var;
+}
+
 static Type *lookup_typedef(Token *tok) {
   if (tok->kind == TK_IDENT) {
-    VarScope *sc = lookup_var(get_identifier(tok));
+    VarScope *sc = lookup_var(tok->name);
     if (sc)
       return sc->type_def;
   }
@@ -256,7 +301,7 @@ static Type *lookup_typedef(Token *tok) {
 
 static TagScope *lookup_tag(char *name) {
   for (TagScope *sc = tag_scope; sc; sc = sc->next) {
-    if (!strcmp(sc->name, name))
+    if (sc->name == name)
       return sc;
   }
   return NULL;
@@ -315,12 +360,22 @@ static Node *new_node_num_ulong(long val, Token *tok) {
   return node;
 }
 
+// size of the element that a pointer (or an array) of `ty` points to
+static Node *elem_size(Type *ty, Token *tok) {
+  if (ty->kind != TY_VLA)
+    return new_node_num(size_of(ty), tok);
+  if (!ty->vla_size)
+    error_tok(tok, "size of the variable length array is unknown here");
+  return new_node_var(ty->vla_size, tok);
+}
+
 static Node *new_node_add(Node *lhs, Node *rhs, Token *tok) {
   generate_type(lhs);
   generate_type(rhs);
 
-  // number + number
-  if (is_numeric(lhs->ty) && is_numeric(rhs->ty))
+  // number + number, or element-wise vector addition
+  if ((is_numeric(lhs->ty) || is_vector(lhs->ty)) &&
+      (is_numeric(rhs->ty) || is_vector(rhs->ty)))
     return new_node_binary(ND_ADD, lhs, rhs, tok);
 
   // ptr + ptr (illegal)
@@ -336,7 +391,7 @@ static Node *new_node_add(Node *lhs, Node *rhs, Token *tok) {
 
   // ptr + number (multiplied by base size of ptr)
   if (is_pointer_like(lhs->ty) && is_integer(rhs->ty)) {
-    rhs = new_node_binary(ND_MUL, rhs, new_node_num(size_of(lhs->ty->base), tok), tok);
+    rhs = new_node_binary(ND_MUL, rhs, elem_size(lhs->ty->base, tok), tok);
     return new_node_binary(ND_ADD, lhs, rhs, tok);
   }
 
@@ -347,26 +402,36 @@ static Node *new_node_sub(Node *lhs, Node *rhs, Token *tok) {
   generate_type(lhs);
   generate_type(rhs);
 
-  // number - number
-  if (is_numeric(lhs->ty) && is_numeric(rhs->ty))
+  // number - number, or element-wise vector subtraction
+  if ((is_numeric(lhs->ty) || is_vector(lhs->ty)) &&
+      (is_numeric(rhs->ty) || is_vector(rhs->ty)))
     return new_node_binary(ND_SUB, lhs, rhs, tok);
 
   // ptr - number (multiplied by base size of ptr)
   if (is_pointer_like(lhs->ty) && is_integer(rhs->ty)) {
-    rhs = new_node_binary(ND_MUL, rhs, new_node_num(size_of(lhs->ty->base), tok), tok);
+    rhs = new_node_binary(ND_MUL, rhs, elem_size(lhs->ty->base, tok), tok);
     return new_node_binary(ND_SUB, lhs, rhs, tok);
   }
 
   // ptr - ptr: returns how many elements are between the two
   if (is_pointer_like(lhs->ty) && is_pointer_like(rhs->ty)) {
     Node *node = new_node_binary(ND_SUB, lhs, rhs, tok);
-    return new_node_binary(ND_DIV, node, new_node_num(size_of(lhs->ty->base), tok), tok);
+    return new_node_binary(ND_DIV, node, elem_size(lhs->ty->base, tok), tok);
   }
 
   // number - ptr (illegal)
   error_tok(tok, "invalid operands");
 }
 
+// x[y] is syntax sugar for *(x + y). a vector is indexed by its lanes,
+// i.e. v[i] is *((T *)&v + i) for a vector of T
+static Node *new_subscript(Node *lhs, Node *idx, Token *tok) {
+  generate_type(lhs);
+  if (is_vector(lhs->ty))
+    lhs = new_node_cast(lhs, pointer_to(lhs->ty->base));
+  return new_node_unary(ND_DEREF, new_node_add(lhs, idx, tok), tok);
+}
+
 Node *new_node_cast(Node *expr, Type *ty) {
   generate_type(expr);
 
@@ -378,14 +443,11 @@ Node *new_node_cast(Node *expr, Type *ty) {
 // create a lvar node for "__func__" that refers to the name of the current function
 static void add_func_ident(char *funcname) {
   Var *var = new_string_literal(funcname, strlen(funcname) + 1);
-  push_scope("__func__")->var = var;
+  push_scope(intern("__func__", 8))->var = var;
 }
 
 // program = (funcdef | global-var)*
 Program *parse(Token *tok) {
-  // add built-if functon types
-  new_gvar("__builtin_va_start", func_returning(ty_void), true, false);
-
   // read source code until EOF
   Function head = {0};
   Function *cur = &head;
@@ -395,7 +457,7 @@ Program *parse(Token *tok) {
     Token *start = tok;
     VarAttr attr = {0};
     Type *basety = typespec(&tok, tok, &attr);
-    if (consume(&tok, tok, ";"))
+    if (consume_id(&tok, tok, ';'))
       continue;
     Type *ty = declarator(&tok, tok, basety);
 
@@ -403,14 +465,15 @@ Program *parse(Token *tok) {
     // "typedef" basety foo[3], *bar, ..
     if (attr.is_typedef) {
       for(;;) {
+        ty = declarator_attributes(&tok, tok, ty);
         if (!ty->ident)
           error_tok(ty->name_pos, "typedef name omitted");
 
         push_scope(get_identifier(ty->ident))->type_def =ty;
 
-        if (consume(&tok, tok, ";"))
+        if (consume_id(&tok, tok, ';'))
           break;
-        tok =  skip(tok, ",");
+        tok =  skip_id(tok, ',');
         ty = declarator(&tok, tok, basety);
       }
       continue;
@@ -418,26 +481,36 @@ Program *parse(Token *tok) {
 
     // function
     if (ty->kind == TY_FUNC) {
-      current_fn = new_gvar(get_identifier(ty->ident), ty, attr.is_static, false);
-      if (!consume(&tok, tok, ";"))
+      tok = attribute_list(tok, &attr);
+      current_fn = new_func_var(get_identifier(ty->ident), ty, &attr);
+      if (!consume_id(&tok, tok, ';')) {
         cur = cur->next = funcdef(&tok, start);
+        cur->is_static = current_fn->is_static;
+        cur->is_cold = current_fn->is_cold;
+        current_fn->fn = cur;
+      }
+      current_fn = NULL;
       continue;
     }
 
     // global variable = typespec declarator ("," declarator)* ";"
     for (;;) {
+      ty = declarator_attributes(&tok, tok, ty);
       if (!ty->ident)
         error_tok(ty->name_pos, "variable name omitted");
+      if (is_variably_modified(ty))
+        error_tok(ty->name_pos, "variably modified type at file scope");
       Var *var = new_gvar(get_identifier(ty->ident), ty, attr.is_static, !attr.is_extern);
+      var->is_tls = attr.is_tls;
       if (attr.align)
         var->align = attr.align;
 
-      if (consume(&tok, tok, "="))
+      if (consume_id(&tok, tok, '='))
         gvar_initializer(&tok, tok, var);
 
-      if (consume(&tok, tok, ";"))
+      if (consume_id(&tok, tok, ';'))
         break;
-      tok =  skip(tok, ",");
+      tok =  skip_id(tok, ',');
       ty = declarator(&tok, tok, basety);
     }
   }
@@ -449,6 +522,72 @@ Program *parse(Token *tok) {
   return prog;
 }
 
+// attribute = "__attribute__" "(" "(" (attr-name ("(" ... ")")? ","?)* ")" ")"
+// only "cold" and "vector_size" have an effect; any other attribute is
+// accepted and ignored
+static Token *attribute_list(Token *tok, VarAttr *attr) {
+  while (consume_id(&tok, tok, KW_ATTRIBUTE)) {
+    tok = skip_id(tok, '(');
+    tok = skip_id(tok, '(');
+    while (tok->id != ')') {
+      if (tok->kind != TK_IDENT && tok->kind != TK_RESERVED)
+        error_tok(tok, "expected an attribute name");
+      if (equal(tok, "cold") || equal(tok, "__cold__"))
+        attr->is_cold = true;
+
+      if (equal(tok, "vector_size") || equal(tok, "__vector_size__")) {
+        tok = skip_id(tok->next, '(');
+        attr->vector_size = const_expr(&tok, tok);
+        tok = skip_id(tok, ')');
+      } else {
+        tok = tok->next;
+        // skip the arguments, if any
+        if (tok->id == '(') {
+          int depth = 0;
+          do {
+            if (tok->kind == TK_EOF)
+              error_tok(tok, "unterminated attribute");
+            if (tok->id == '(')
+              depth++;
+            else if (tok->id == ')')
+              depth--;
+            tok = tok->next;
+          } while (depth > 0);
+        }
+      }
+
+      if (!consume_id(&tok, tok, ','))
+        break;
+    }
+    tok = skip_id(tok, ')');
+    tok = skip_id(tok, ')');
+  }
+  return tok;
+}
+
+static Type *vector_type(Type *base, int size, Token *tok) {
+  if (!is_numeric(base) || base->kind == TY_BOOL)
+    error_tok(tok, "invalid vector element type");
+  if (size != 16)
+    error_tok(tok, "only 16-byte vectors are supported");
+  return vector_of(base, size);
+}
+
+// attributes following a declarator apply to the declared type,
+// e.g. typedef float v4sf __attribute__((vector_size(16)));
+static Type *declarator_attributes(Token **rest, Token *tok, Type *ty) {
+  Token *start = tok;
+  VarAttr attr = {0};
+  *rest = attribute_list(tok, &attr);
+  if (!attr.vector_size)
+    return ty;
+
+  Type *vec = vector_type(ty, attr.vector_size, start);
+  vec->ident = ty->ident;
+  vec->name_pos = ty->name_pos;
+  return vec;
+}
+
 // typespec = typename typename*
 // typename = "void" | "_Bool" | "char" | "int" | "short" | "long" |
 //            "struct" struct_dec | "union" union-decll
@@ -471,61 +610,101 @@ static Type *typespec(Token **rest, Token *tok, VarAttr *attr) {
   Type *ty = ty_int;
   int counter = 0;
   bool is_const = false;
+  bool is_atomic = false;
+  int vector_size = 0;
+  Token *vector_tok = NULL;
 
   while (is_typename(tok)) {
     // handle storage class specifiers
-    if (equal(tok, "typedef") || equal(tok, "static") || equal(tok, "extern")) {
+    if (tok->id == KW_TYPEDEF || tok->id == KW_STATIC || tok->id == KW_EXTERN) {
       if (!attr)
         error_tok(tok, "storage class specifier is not allowed in this context");
 
-      if (consume(&tok, tok, "typedef"))
+      if (tok->id == KW_TYPEDEF)
         attr->is_typedef = true;
-      else if(consume(&tok, tok, "static"))
+      else if (tok->id == KW_STATIC)
         attr->is_static = true;
-      else if(consume(&tok, tok, "extern"))
-        attr->is_extern = true;
       else
-        error_tok(tok, "internal error");
+        attr->is_extern = true;
+      tok = tok->next;
 
       if (attr->is_typedef + attr->is_static + attr->is_extern > 1)
         error_tok(tok, "typedef and static may not be used together");
       continue;
     }
 
-    if (consume(&tok, tok, "const")) {
+    if (tok->id == KW_ATTRIBUTE) {
+      VarAttr attr2 = {0};
+      Token *start = tok;
+      tok = attribute_list(tok, &attr2);
+      if (attr)
+        attr->is_cold |= attr2.is_cold;
+      if (attr2.vector_size) {
+        vector_size = attr2.vector_size;
+        vector_tok = start;
+      }
+      continue;
+    }
+
+    if (tok->id == KW_THREAD_LOCAL) {
+      if (!attr)
+        error_tok(tok, "storage class specifier is not allowed in this context");
+      attr->is_tls = true;
+      tok = tok->next;
+      continue;
+    }
+
+    if (tok->id == KW_CONST) {
       is_const = true;
+      tok = tok->next;
+      continue;
+    }
+
+    if (tok->id == KW_VOLATILE) {
+      tok = tok->next;
       continue;
     }
 
-    if (consume(&tok, tok, "volatile")) {
+    // "_Atomic" is either a qualifier or a specifier "_Atomic" "(" typename ")"
+    if (tok->id == KW_ATOMIC) {
+      tok = tok->next;
+      is_atomic = true;
+      if (tok->id == '(') {
+        // after other specifiers, the parenthesis belongs to the declarator
+        if (counter)
+          break;
+        ty = typename(&tok, tok->next);
+        tok = skip_id(tok, ')');
+        counter += OTHER;
+      }
       continue;
     }
 
-    if (equal(tok, "_Alignas")) {
+    if (tok->id == KW_ALIGNAS) {
       if (!attr)
         error_tok(tok, "_Alignas is not allowed in this context");
 
-      tok = skip(tok->next, "(");
+      tok = skip_id(tok->next, '(');
 
       if (is_typename(tok))
         attr->align = typename(&tok, tok)->align;
       else
         attr->align = const_expr(&tok, tok);
-      tok = skip(tok, ")");
+      tok = skip_id(tok, ')');
       continue;
     }
 
     // Handle user-defined tyees
     Type *ty2 = lookup_typedef(tok);
-    if (equal(tok, "struct") || equal(tok, "union") || equal(tok, "enum") || ty2) {
+    if (tok->id == KW_STRUCT || tok->id == KW_UNION || tok->id == KW_ENUM || ty2) {
       if (counter)
         break;
 
-      if (equal(tok, "struct")) {
+      if (tok->id == KW_STRUCT) {
         ty = struct_decl(&tok, tok->next);
-      } else if (equal(tok, "union")) {
+      } else if (tok->id == KW_UNION) {
         ty = union_decl(&tok, tok->next);
-      } else if (equal(tok, "enum")) {
+      } else if (tok->id == KW_ENUM) {
         ty = enum_specifier(&tok, tok->next);
       } else {
         ty = ty2;
@@ -537,28 +716,40 @@ static Type *typespec(Token **rest, Token *tok, VarAttr *attr) {
     }
 
     // Handle built-in types.
-    if (equal(tok, "void"))
+    switch (tok->id) {
+    case KW_VOID:
       counter += VOID;
-    else if (equal(tok, "_Bool"))
+      break;
+    case KW_BOOL:
       counter += BOOL;
-    else if (equal(tok, "char"))
+      break;
+    case KW_CHAR:
       counter += CHAR;
-    else if (equal(tok, "short"))
+      break;
+    case KW_SHORT:
       counter += SHORT;
-    else if (equal(tok, "int"))
+      break;
+    case KW_INT:
       counter += INT;
-    else if (equal(tok, "long"))
+      break;
+    case KW_LONG:
       counter += LONG;
-    else if (equal(tok, "float"))
+      break;
+    case KW_FLOAT:
       counter += FLOAT;
-    else if (equal(tok, "double"))
+      break;
+    case KW_DOUBLE:
       counter += DOUBLE;
-    else if (equal(tok, "signed"))
+      break;
+    case KW_SIGNED:
       counter |= SIGNED;
-    else if (equal(tok, "unsigned"))
+      break;
+    case KW_UNSIGNED:
       counter |= UNSIGNED;
-    else
+      break;
+    default:
       error_tok(tok, "internal error");
+    }
 
     switch (counter) {
     case VOID:
@@ -623,44 +814,56 @@ static Type *typespec(Token **rest, Token *tok, VarAttr *attr) {
     tok = tok->next;
   }
 
+  if (vector_size)
+    ty = vector_type(ty, vector_size, vector_tok);
+
   if (is_const) {
     ty = copy_ty(ty);
     ty->is_const = true;
   }
 
+  if (is_atomic) {
+    ty = copy_ty(ty);
+    ty->is_atomic = true;
+  }
+
   *rest = tok;
   return ty;
 }
 
 // array-dimensions = "[" const-expr? "]" type-suffix
 static Type *array_dimensions(Token **rest, Token *tok, Type *ty) {
-  tok = skip(tok, "[");
-  if (equal(tok, "]")) {
+  tok = skip_id(tok, '[');
+  if (tok->id == ']') {
     ty = type_suffix(rest, tok->next, ty);
     ty = array_of(ty, 0);
     ty->is_incomplete = true;
     return ty;
   }
 
-  int sz = const_expr(&tok, tok);
-  tok =  skip(tok, "]");
+  Node *len = conditional(&tok, tok);
+  tok =  skip_id(tok, ']');
   ty = type_suffix(rest, tok, ty);  // first, define rightmost sub-array's size
-  return array_of(ty, sz);          // this array composes of sz length of subarrays above
+
+  // an array of variable-length arrays is variable-length itself
+  if (ty->kind == TY_VLA || !is_const_expr(len))
+    return vla_of(ty, len);
+  return array_of(ty, eval(len));   // this array composes of sz length of subarrays above
 }
 
 // type-suffix = "(" func-params ")"
 //             | array-dimensions
 //             | ε
 static Type *type_suffix(Token **rest, Token *tok, Type *ty) {
-  if (consume(&tok, tok, "(")) {
+  if (consume_id(&tok, tok, '(')) {
     ty = func_params(&tok, tok, ty);
-    tok =  skip(tok, ")");
+    tok =  skip_id(tok, ')');
 
     *rest = tok;
     return ty;
   }
 
-  if (equal(tok, "["))
+  if (tok->id == '[')
     return array_dimensions(rest, tok, ty);
 
   *rest = tok;
@@ -670,11 +873,13 @@ static Type *type_suffix(Token **rest, Token *tok, Type *ty) {
 // pointers = ("*" "const"*)*
 static Type *pointers(Token **rest, Token *tok, Type *ty) {
 
-  while (consume(&tok, tok, "*")) {
+  while (consume_id(&tok, tok, '*')) {
     ty = pointer_to(ty);
-    while (equal(tok, "const") || equal(tok, "volatile")) {
-      if (equal(tok, "const"))
+    while (tok->id == KW_CONST || tok->id == KW_VOLATILE || tok->id == KW_ATOMIC) {
+      if (tok->id == KW_CONST)
         ty->is_const = true;
+      if (tok->id == KW_ATOMIC)
+        ty->is_atomic = true;
       tok = tok->next;
     }
   }
@@ -687,10 +892,10 @@ static Type *pointers(Token **rest, Token *tok, Type *ty) {
 static Type *declarator(Token **rest, Token *tok, Type *ty) {
   ty = pointers(&tok, tok, ty);
 
-  if (consume(&tok, tok, "(")) {
+  if (consume_id(&tok, tok, '(')) {
     Type *placeholder = calloc(1, sizeof(Type));
     Type *new_ty = declarator(&tok, tok, placeholder);
-    tok =  skip(tok, ")");
+    tok =  skip_id(tok, ')');
     *placeholder = *type_suffix(&tok, tok, ty);
     *rest = tok;
     return new_ty;
@@ -715,10 +920,10 @@ static Type *declarator(Token **rest, Token *tok, Type *ty) {
 static Type *abstract_declarator(Token **rest, Token *tok, Type *ty) {
   ty = pointers(&tok, tok, ty);
 
-  if (consume(&tok, tok, "(")) {
+  if (consume_id(&tok, tok, '(')) {
     Type *placeholder = calloc(1, sizeof(Type));
     Type *new_ty = abstract_declarator(&tok, tok, placeholder);
-    tok =  skip(tok, ")");
+    tok =  skip_id(tok, ')');
     *placeholder = *type_suffix(rest, tok, ty);
     return new_ty;
   }
@@ -733,16 +938,16 @@ static Type *typename(Token **rest, Token *tok) {
 }
 
 static bool is_end(Token *tok) {
-  return equal(tok, "}") || (equal(tok, ",") && equal(tok->next, "}"));
+  return tok->id == '}' || (tok->id == ',' && tok->next->id == '}');
 }
 
 static bool consume_end(Token **rest, Token *tok) {
-  if (equal(tok, "}")) {
+  if (tok->id == '}') {
     *rest = tok->next;
     return true;
   }
 
-  if (equal(tok, ",") && equal(tok->next, "}")) {
+  if (tok->id == ',' && tok->next->id == '}') {
     *rest = tok->next->next;
     return true;
   }
@@ -754,15 +959,15 @@ static bool consume_end(Token **rest, Token *tok) {
 static void register_enum_list(Token **rest, Token *tok, Type *ty) {
   int i = 0;
   int val = 0;
-  tok = skip(tok, "{");
+  tok = skip_id(tok, '{');
 
   while (!consume_end(rest, tok)) {
     if (i++ > 0)
-      tok = skip(tok, ",");
+      tok = skip_id(tok, ',');
 
     char *tag_name = expect_ident(&tok, tok);
 
-    if (equal(tok, "="))
+    if (tok->id == '=')
       val = const_expr(&tok, tok->next);
 
     VarScope *sc = push_scope(tag_name);
@@ -781,7 +986,7 @@ static Type *enum_specifier(Token **rest, Token *tok) {
   if (tok->kind == TK_IDENT)
     tag_name = expect_ident(&tok, tok);
 
-  if (tag_name && !equal(tok, "{")) {
+  if (tag_name && tok->id != '{') {
     TagScope *sc = lookup_tag(tag_name);
     if (!sc)
       error_tok(start, "unknown enum type");
@@ -802,6 +1007,48 @@ static Type *enum_specifier(Token **rest, Token *tok) {
   return ty;
 }
 
+static bool is_variably_modified(Type *ty) {
+  return ty->kind == TY_VLA || (ty->base && is_variably_modified(ty->base));
+}
+
+// evaluates the sizes of the variable-length arrays in `ty` (innermost first)
+// into hidden variables, at the point where the type is declared
+static Node *compute_vla_size(Type *ty, Token *tok) {
+  Node *node = new_node(ND_NULL_EXPR, tok);
+  if (ty->base)
+    node = new_node_binary(ND_COMMA, node, compute_vla_size(ty->base, tok), tok);
+
+  if (ty->kind != TY_VLA || ty->vla_size)
+    return node;
+
+  Node *len = new_node_cast(ty->vla_len, ty_ulong);
+  ty->vla_size = new_lvar("", ty_ulong);
+  Node *expr = new_node_binary(ND_ASSIGN, new_node_var(ty->vla_size, tok),
+                               new_node_binary(ND_MUL, len, elem_size(ty->base, tok), tok), tok);
+  return new_node_binary(ND_COMMA, node, expr, tok);
+}
+
+// a VLA variable is a pointer to an alloca()'ed area. the area is released
+// when the innermost enclosing block or loop is left (see ND_BLOCK in codegen)
+static Node *declare_vla(Var *var, Token *tok) {
+  Node *node = new_node(ND_NULL_EXPR, tok);
+
+  if (!vla_save) {
+    vla_save = new_lvar("", pointer_to(ty_char));
+    Node *bottom = new_node_var(get_alloca_bottom(), tok);
+    node = new_node_binary(ND_ASSIGN, new_node_var(vla_save, tok), bottom, tok);
+  }
+
+  Node *ptr = new_node(ND_VLA_PTR, tok);
+  ptr->var = var;
+  ptr->ty = pointer_to(var->ty->base);
+
+  Node *area = new_alloca(new_node_var(var->ty->vla_size, tok));
+  Node *expr = new_node_binary(ND_ASSIGN, ptr, area, tok);
+  vla_count++;
+  return new_node_binary(ND_COMMA, node, expr, tok);
+}
+
 // declaration = typespec (declarator ( = expr)? ( "," declarator ( = expr)? )* )? ";"
 static Node *declaration(Token **rest, Token *tok) {
   Node head = {};
@@ -812,38 +1059,57 @@ static Node *declaration(Token **rest, Token *tok) {
   Type *basety = typespec(&tok, tok, &attr);
 
   int cnt = 0;
-  while(!consume(&tok, tok, ";")) {
+  while(!consume_id(&tok, tok, ';')) {
     if (cnt++ > 0)
-      tok =  skip(tok, ",");
+      tok =  skip_id(tok, ',');
 
     Token *start = tok;
     Type *ty = declarator(&tok, tok, basety);
+    ty = declarator_attributes(&tok, tok, ty);
 
     if (!ty->ident)
       error_tok(ty->name_pos, "variable declared void");
     if (ty->kind == TY_VOID)
       error_tok(start, "variable declared void");
 
+    if (is_variably_modified(ty))
+      cur = cur->next = new_node_unary(ND_EXPR_STMT, compute_vla_size(ty, start), start);
+
     if (attr.is_typedef) {
       push_scope(get_identifier(ty->ident))->type_def = ty;
       continue;
     }
 
+    if (ty->kind == TY_VLA) {
+      if (attr.is_static)
+        error_tok(start, "variable length array declared static");
+      if (tok->id == '=')
+        error_tok(tok, "variable-sized object may not be initialized");
+
+      Var *var = new_lvar(get_identifier(ty->ident), ty);
+      cur = cur->next = new_node_unary(ND_EXPR_STMT, declare_vla(var, start), start);
+      continue;
+    }
+
     if (attr.is_static) {
       // static local variable
       Var *var = new_gvar(new_gvar_name(), ty, true, true);
+      var->is_tls = attr.is_tls;
       push_scope(get_identifier(ty->ident))->var = var;
 
-      if (equal(tok, "="))
+      if (tok->id == '=')
         gvar_initializer(&tok, tok->next, var);
       continue;
     }
 
+    if (attr.is_tls)
+      error_tok(start, "_Thread_local in block scope must be static");
+
     Var *var = new_lvar(get_identifier(ty->ident), ty);
     if (attr.align)
       var->align = attr.align;
 
-    if (consume(&tok, tok, "=")) {
+    if (consume_id(&tok, tok, '=')) {
       Node *expr = lvar_initializer(&tok, tok, var);
       cur = cur->next = new_node_unary(ND_EXPR_STMT, expr, tok);
     }
@@ -858,8 +1124,8 @@ static Node *declaration(Token **rest, Token *tok) {
 
 static Token *skip_excess_elements(Token *tok) {
   while(!consume_end(&tok, tok)) {
-    tok = skip(tok, ",");
-    if (equal(tok, "{"))
+    tok = skip_id(tok, ',');
+    if (tok->id == '{')
       tok = skip_excess_elements(tok->next);
     else
       assign(&tok, tok);
@@ -876,18 +1142,19 @@ static Token *skip_end(Token *tok) {
 
 // string-initializer = string-literal
 static Initializer *string_initializer(Token **rest, Token *tok, Type *ty) {
+  Literal *lit = token_lit(tok);
   if (ty->is_incomplete) {
-    ty->size = tok->cont_len;
-    ty->array_len = tok->cont_len;
+    ty->size = lit->cont_len;
+    ty->array_len = lit->cont_len;
     ty->is_incomplete = false;
   }
 
   Initializer *init = new_init(ty, ty->array_len, NULL, tok);
 
-  int len = (ty->array_len < tok->cont_len) ? ty->array_len : tok->cont_len;
+  int len = (ty->array_len < lit->cont_len) ? ty->array_len : lit->cont_len;
 
   for (int i = 0; i < len; i++) {
-    Node *expr = new_node_num(tok->contents[i], tok);
+    Node *expr = new_node_num(lit->contents[i], tok);
     init->children[i] = new_init(ty->base, 0, expr, tok);
   }
   *rest = tok->next;
@@ -897,13 +1164,13 @@ static Initializer *string_initializer(Token **rest, Token *tok, Type *ty) {
 // array-initializer = "{" initializer ("," initializer)* ","? "}"
 //                    | initializer ("," initializer)* ","?
 static Initializer *array_initializer(Token **rest, Token *tok, Type *ty) {
-  bool has_paren = consume(&tok, tok, "{");
+  bool has_paren = consume_id(&tok, tok, '{');
 
   if (ty->is_incomplete) {
     int i = 0;
     for (Token *tok2 = tok; !is_end(tok2); i++) {
       if (i > 0)
-        tok2 = skip(tok2, ",");
+        tok2 = skip_id(tok2, ',');
       initializer(&tok2, tok2, ty->base);
     }
 
@@ -916,7 +1183,7 @@ static Initializer *array_initializer(Token **rest, Token *tok, Type *ty) {
 
   for (int i = 0; i < ty->array_len && !is_end(tok); i++) {
     if (i > 0)
-      tok = skip(tok, ",");
+      tok = skip_id(tok, ',');
     init->children[i] = initializer(&tok, tok, ty->base);
   }
 
@@ -929,7 +1196,7 @@ static Initializer *array_initializer(Token **rest, Token *tok, Type *ty) {
 // struct-initializer = "{" initializer ("," initializer)* ","? "}"
 //                    | initializer ("," initializer)* ","?
 static Initializer *struct_initializer(Token **rest, Token *tok, Type *ty) {
-  if (!equal(tok, "{")) {
+  if (tok->id != '{') {
     Token *tok2;
     Node *expr = assign(&tok2, tok);
     generate_type(expr);
@@ -945,12 +1212,12 @@ static Initializer *struct_initializer(Token **rest, Token *tok, Type *ty) {
     len++;
 
   Initializer *init = new_init(ty, len, NULL, tok);
-  bool has_paren = consume(&tok, tok, "{");
+  bool has_paren = consume_id(&tok, tok, '{');
 
   int i = 0;
   for (Member *mem = ty->members; mem && !is_end(tok); mem = mem->next, i++) {
     if (i > 0)
-      tok = skip(tok, ",");
+      tok = skip_id(tok, ',');
     init->children[i] = initializer(&tok, tok, mem->ty);
   }
 
@@ -969,11 +1236,15 @@ static Initializer *initializer(Token **rest, Token *tok, Type *ty) {
   if (ty->kind == TY_ARRAY)
     return array_initializer(rest, tok, ty);
 
+  // a vector is initialized lane by lane, like an array
+  if (ty->kind == TY_VECTOR && tok->id == '{')
+    return array_initializer(rest, tok, ty);
+
   if (ty->kind == TY_STRUCT)
     return struct_initializer(rest, tok, ty);
 
   Token *start = tok;
-  bool has_paren = consume(&tok, tok, "{");
+  bool has_paren = consume_id(&tok, tok, '{');
   Initializer *init = new_init(ty, 0, assign(&tok, tok), start);
   if (has_paren)
     tok = skip_end(tok);
@@ -995,30 +1266,48 @@ Node *init_desg_expr(InitDesg *desg, Token *tok) {
   Node *lhs = init_desg_expr(desg->next, tok);
   Node *rhs = new_node_num(desg->idx, tok);
 
-  return new_node_unary(ND_DEREF, new_node_add(lhs, rhs, tok), tok);
+  return new_subscript(lhs, rhs, tok);
+}
+
+// true if the initializer can be left to the zero-clear of the variable:
+// either omitted or a literal integer zero
+static bool is_zero_init(Initializer *init) {
+  if (!init)
+    return true;
+
+  Node *expr = init->expr;
+  return expr && expr->kind == ND_NUM && expr->val == 0 &&
+         !(expr->ty && is_flonum(expr->ty));
 }
 
+// aggregates are zero-cleared before this runs (see lvar_initializer),
+// so only elements with explicit non-zero initializers are assigned
 static Node *create_lvar_init(Initializer *init, Type *ty, InitDesg *desg, Token *tok) {
-  if (ty->kind == TY_ARRAY) {
+  if (ty->kind == TY_ARRAY || (ty->kind == TY_VECTOR && init->len)) {
     Node *node = new_node(ND_NULL_EXPR, tok);
 
-    int sz = size_of(ty->base); // FIXME: unsed variable?
     for (int i = 0; i < ty->array_len; i++) {
+      Initializer *child = init->children[i];
+      if (is_zero_init(child))
+        continue;
+
       InitDesg desg2 = {desg, i};
-      Initializer *child = init ? init->children[i] : NULL;
       Node *rhs = create_lvar_init(child, ty->base, &desg2, tok);
       node = new_node_binary(ND_COMMA, node, rhs, tok);
     }
     return node;
   }
 
-  if (ty->kind == TY_STRUCT && (!init || init->len)) {
+  if (ty->kind == TY_STRUCT && init->len) {
     Node *node = new_node(ND_NULL_EXPR, tok);
 
     int i = 0;
     for (Member *mem = ty->members; mem; mem = mem->next, i++) {
+      Initializer *child = init->children[i];
+      if (is_zero_init(child))
+        continue;
+
       InitDesg desg2 = {desg, 0, mem};
-      Initializer *child = init ? init->children[i] : NULL;
       Node *rhs = create_lvar_init(child, mem->ty, &desg2, tok);
       node = new_node_binary(ND_COMMA, node, rhs, tok);
     }
@@ -1026,8 +1315,7 @@ static Node *create_lvar_init(Initializer *init, Type *ty, InitDesg *desg, Token
   }
 
   Node *lhs = init_desg_expr(desg, tok);
-  Node *rhs = init ? init->expr : new_node_num(0, tok);
-  Node *expr = new_node_binary(ND_ASSIGN, lhs, rhs, tok);
+  Node *expr = new_node_binary(ND_ASSIGN, lhs, init->expr, tok);
   expr->is_init = true;
   return expr;
 }
@@ -1035,22 +1323,22 @@ static Node *create_lvar_init(Initializer *init, Type *ty, InitDesg *desg, Token
 static Node *lvar_initializer(Token **rest, Token *tok, Var *var) {
   Initializer *init = initializer(rest, tok, var->ty);
   InitDesg desg = {NULL, 0, NULL, var};
-  return create_lvar_init(init, var->ty, &desg, tok);
+
+  Node *rhs = create_lvar_init(init, var->ty, &desg, tok);
+
+  // scalars and structs copied from an expression are assigned as a whole
+  if (init->expr)
+    return rhs;
+
+  Node *lhs = new_node(ND_MEMZERO, tok);
+  lhs->var = var;
+  return new_node_binary(ND_COMMA, lhs, rhs, tok);
 }
 
 // whether given token reprents a type
 static bool is_typename(Token *tok) {
-  static char *kw[] = {
-    "void", "_Bool", "signed", "unsigned",
-    "char", "short", "int", "long", "float", "double",
-    "struct", "union", "typedef", "enum",
-    "extern", "static", "_Alignas", "const", "volatile",
-  };
-
-  for (int i = 0; i < sizeof(kw) / sizeof(*kw); i++)
-    if (equal(tok, kw[i]))
-      return true;
-
+  if (KW_VOID <= tok->id && tok->id <= KW_ATTRIBUTE)
+    return true;
   return lookup_typedef(tok);
 }
 
@@ -1072,9 +1360,37 @@ static void write_buf(char *buf, unsigned long val, int sz) {
   }
 }
 
+static Relocation *
+write_gvar_scalar(Relocation *cur, Node *expr, Type *ty, char *buf, int offset) {
+  if (ty->kind == TY_FLOAT) {
+    *(float *)(buf + offset) = eval_double(expr);
+    return cur;
+  }
+
+  if (ty->kind == TY_DOUBLE) {
+    *(double *)(buf + offset) = eval_double(expr);
+    return cur;
+  }
+
+  Var *var = NULL;
+  long val = eval2(expr, &var);
+
+  if (var) {
+    Relocation *rel = calloc(1, sizeof(Relocation));
+    rel->offset = offset;
+    rel->var = var;
+    rel->addend = val;
+    cur->next = rel;
+    return cur->next;
+  }
+
+  write_buf(buf + offset, val, size_of(ty));
+  return cur;
+}
+
 static Relocation *
 write_gvar_data(Relocation *cur, Initializer *init, Type *ty, char *buf, int offset) {
-  if (ty->kind == TY_ARRAY) {
+  if (ty->kind == TY_ARRAY || ty->kind == TY_VECTOR) {
     int sz = size_of(ty->base);
     for (int i = 0; i < ty->array_len; i++) {
       Initializer *child = init->children[i];
@@ -1094,36 +1410,159 @@ write_gvar_data(Relocation *cur, Initializer *init, Type *ty, char *buf, int off
     return cur;
   }
 
-  if (ty->kind == TY_FLOAT) {
-    *(float *)(buf + offset) = eval_double(init->expr);
-    return cur;
+  return write_gvar_scalar(cur, init->expr, ty, buf, offset);
+}
+
+// writes a plain (optionally negated) numeric literal followed by "," or "}"
+// without building a node. this is the common case in generated tables.
+static bool write_num_literal(Token **rest, Token *tok, Type *ty, char *buf) {
+  bool neg = tok->id == '-';
+  Token *num = neg ? tok->next : tok;
+
+  if (num->kind != TK_NUM || !(num->next->id == ',' || num->next->id == '}'))
+    return false;
+
+  Literal *lit = token_lit(num);
+  if (is_flonum(ty)) {
+    double fval;
+    if (is_flonum(lit->ty))
+      fval = lit->fval;
+    else if (lit->ty->is_unsigned)
+      fval = (unsigned long)lit->val;
+    else
+      fval = lit->val;
+
+    if (ty->kind == TY_FLOAT)
+      *(float *)buf = neg ? -fval : fval;
+    else
+      *(double *)buf = neg ? -fval : fval;
+  } else {
+    long val = is_flonum(lit->ty) ? (long)lit->fval : lit->val;
+    write_buf(buf, neg ? -val : val, size_of(ty));
   }
 
-  if (ty->kind == TY_DOUBLE) {
-    *(double *)(buf + offset) = eval_double(init->expr);
-    return cur;
+  *rest = num->next;
+  return true;
+}
+
+// writes the first `n` bytes of an #embed resource as array elements.
+// byte arrays are not read at all but left to the assembler (`.incbin`).
+static int write_embed(Incbin **cur, Token *tok, Type *ty, char *buf, int offset, int n) {
+  if (size_of(ty) == 1 && ty->kind != TY_BOOL) {
+    Incbin *inc = calloc(1, sizeof(Incbin));
+    inc->offset = offset;
+    inc->len = n;
+    inc->path = token_lit(tok)->embed_path;
+    *cur = (*cur)->next = inc;
+    return n;
   }
 
-  Var *var = NULL;
-  long val = eval2(init->expr, &var);
+  unsigned char *bytes = (unsigned char *)embed_contents(tok);
+  int sz = size_of(ty);
 
-  if (var) {
-    Relocation *rel = calloc(1, sizeof(Relocation));
-    rel->offset = offset;
-    rel->label = var->name;
-    rel->addend = val;
-    cur->next = rel;
-    return cur->next;
+  for (int i = 0; i < n; i++) {
+    if (ty->kind == TY_FLOAT)
+      *(float *)(buf + i * sz) = bytes[i];
+    else if (ty->kind == TY_DOUBLE)
+      *(double *)(buf + i * sz) = bytes[i];
+    else if (ty->kind == TY_BOOL)
+      write_buf(buf + i * sz, bytes[i] != 0, sz);
+    else
+      write_buf(buf + i * sz, bytes[i], sz);
   }
+  return n;
+}
 
-  write_buf(buf + offset, val, size_of(ty));
-  return cur;
+// whether a global array initializer can be read by flat_gvar_initializer
+static bool is_flat_initializer(Token *tok, Type *ty) {
+  if (ty->kind != TY_ARRAY || tok->id != '{')
+    return false;
+
+  Type *base = ty->base;
+  if (!is_numeric(base) && base->kind != TY_PTR)
+    return false;
+
+  // char s[] = {"foo"} is a string initializer
+  return !(base->kind == TY_CHAR && tok->next->kind == TK_STR);
+}
+
+// array-of-scalars initializer = "{" scalar ("," scalar)* ","? "}"
+// where scalar = assign | "{" assign "}"
+//
+// elements are evaluated straight into the flat data buffer as they are
+// parsed (with a relocation list for pointers), so that large tables
+// do not need an Initializer tree with a node for every element.
+static void flat_gvar_initializer(Token **rest, Token *tok, Var *var) {
+  Type *ty = var->ty;
+  int sz = size_of(ty->base);
+  int cap = ty->is_incomplete ? 16 : ty->array_len;
+  char *buf = calloc(cap ? cap : 1, sz);
+
+  Relocation head = {0};
+  Relocation *cur = &head;
+
+  Incbin inc_head = {0};
+  Incbin *inc = &inc_head;
+
+  tok = skip_id(tok, '{');
+
+  int i = 0;
+  for (; (ty->is_incomplete || i < ty->array_len) && !is_end(tok); i++) {
+    if (i > 0)
+      tok = skip_id(tok, ',');
+
+    int n = 1;
+    if (tok->kind == TK_EMBED) {
+      n = token_lit(tok)->cont_len;
+      if (!ty->is_incomplete && n > ty->array_len - i) {
+        warn_tok(tok, "excess elements in array initializer");
+        n = ty->array_len - i;
+      }
+    }
+
+    while (i + n > cap) {
+      buf = realloc(buf, cap * 2 * sz);
+      memset(buf + cap * sz, 0, cap * sz);
+      cap *= 2;
+    }
+
+    if (tok->kind == TK_EMBED) {
+      i += write_embed(&inc, tok, ty->base, buf + i * sz, i * sz, n) - 1;
+      tok = tok->next;
+      continue;
+    }
+
+    if (write_num_literal(&tok, tok, ty->base, buf + i * sz))
+      continue;
+
+    bool has_paren = consume_id(&tok, tok, '{');
+    Node *expr = assign(&tok, tok);
+    if (has_paren)
+      tok = skip_end(tok);
+    cur = write_gvar_scalar(cur, expr, ty->base, buf, i * sz);
+  }
+  *rest = skip_end(tok);
+
+  if (ty->is_incomplete) {
+    ty->size = sz * i;
+    ty->array_len = i;
+    ty->is_incomplete = false;
+  }
+
+  var->init_data = buf;
+  var->rel = head.next;
+  var->incbin = inc_head.next;
 }
 
 // serializs Initializer objects to a flat byte array. initial values for
 // gloval vars need to be evaluated at compile time to have embedded
 // into .data section
 static void gvar_initializer(Token **rest, Token *tok, Var *var) {
+  if (is_flat_initializer(tok, var->ty)) {
+    flat_gvar_initializer(rest, tok, var);
+    return;
+  }
+
   Initializer *init = initializer(rest, tok, var->ty);
 
   Relocation head = {0};
@@ -1139,14 +1578,14 @@ static Member *struct_union_members(Token **rest, Token *tok) {
   Member head = {0};
   Member *cur = &head;
 
-  while (!equal(tok, "}")) {
+  while (tok->id != '}') {
     VarAttr attr = {0};
     Type *basety = typespec(&tok, tok, &attr);
     int cnt = 0;
 
-    while (!consume(&tok, tok, ";")) {
+    while (!consume_id(&tok, tok, ';')) {
       if (cnt++)
-        tok =  skip(tok, ",");
+        tok =  skip_id(tok, ',');
 
       Type *ty = declarator(&tok, tok, basety);
       Member *mem = new_member(get_identifier(ty->ident), ty);
@@ -1168,7 +1607,7 @@ static Type *struct_union_decl(Token **rest, Token *tok) {
   if (tok->kind == TK_IDENT)
     tag_name = expect_ident(&tok, tok);
 
-  if (tag_name && !equal(tok, "{")) {
+  if (tag_name && tok->id != '{') {
     *rest = tok;
 
     TagScope *sc = lookup_tag(tag_name);
@@ -1181,10 +1620,10 @@ static Type *struct_union_decl(Token **rest, Token *tok) {
     return ty;
   }
 
-  tok =  skip(tok, "{");
+  tok =  skip_id(tok, '{');
   Type *ty = struct_type();
   ty->members = struct_union_members(&tok, tok);
-  *rest =  skip(tok, "}");
+  *rest =  skip_id(tok, '}');
 
   if (tag_name) {
     // If this a redefinition, overwrite the previous type.
@@ -1237,10 +1676,61 @@ static Type *union_decl(Token **rest, Token *tok) {
   return ty;
 }
 
+// a vector-valued operation leaves its result in a temporary of the frame
+// and evaluates to the address of it, the same way as a struct value does
+static void add_vector_temps(Node *node) {
+  if (!node)
+    return;
+
+  add_vector_temps(node->lhs);
+  add_vector_temps(node->rhs);
+  add_vector_temps(node->cond);
+  add_vector_temps(node->then);
+  add_vector_temps(node->els);
+  add_vector_temps(node->init);
+  add_vector_temps(node->inc);
+  for (Node *n = node->body; n; n = n->next)
+    add_vector_temps(n);
+
+  if (!node->ty || !is_vector(node->ty) || node->var)
+    return;
+
+  switch (node->kind) {
+  case ND_CAST:
+    // vector-to-vector casts reinterpret the value in place
+    if (is_vector(node->lhs->ty))
+      return;
+    // fallthrough
+  case ND_ADD:
+  case ND_SUB:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_MOD:
+  case ND_BITAND:
+  case ND_BITOR:
+  case ND_BITXOR:
+  case ND_BITNOT:
+  case ND_FUNCALL:
+    node->var = new_lvar("", node->ty);
+  }
+}
+
+// "&&label" must name a label of the function it appears in
+static void check_label_vals(void) {
+  for (Node *x = label_vals; x; x = x->label_next) {
+    Node *y = labels;
+    while (y && y->label_name != x->label_name)
+      y = y->label_next;
+    if (!y)
+      error_tok(x->token, "use of undeclared label '%s'", x->label_name);
+  }
+}
+
 // funcdef = { block_stmt }
 // TODO: consider poiter-type
 static Function *funcdef(Token **rest, Token *tok) {
   locals = NULL;
+  labels = label_vals = NULL;
 
   VarAttr attr = {0};
   Type *basety = typespec(&tok, tok, &attr);
@@ -1255,13 +1745,37 @@ static Function *funcdef(Token **rest, Token *tok) {
   for (Type *t = ty->params; t; t = t->next) {
     if (!t->ident)
       error_tok(t->name_pos, "parameter name omitted");
-    Var *var = new_lvar(get_identifier(t->ident), t); // TODO: check if this registratoin order make sense (first defined comes first, latter could overshadow the earlier)
+    add_lvar(t->param_var); // prepended, so func->params lists them last first
   }
 
   func->params = locals;
 
+  // the sizes of variable-length arrays in parameter types, e.g. the
+  // rows of `int m[][n]`, are computed on entry
+  Node head = {};
+  Node *cur = &head;
+  for (Type *t = ty->params; t; t = t->next) {
+    if (is_variably_modified(t)) {
+      cur = cur->next = new_node_unary(ND_EXPR_STMT, compute_vla_size(t, tok), tok);
+      generate_type(cur);
+    }
+  }
+
+  // a struct too large for rax:rdx is returned through a hidden pointer
+  Type *ret_ty = ty->return_ty;
+  if (ret_ty->kind == TY_STRUCT && size_of(ret_ty) > 16)
+    func->struct_ret = new_lvar("", pointer_to(ret_ty));
+
   add_func_ident(func->name);
+  alloca_bottom = NULL;
   func->node = block_stmt(rest, tok);
+  check_label_vals();
+  if (head.next) {
+    cur->next = func->node->body;
+    func->node->body = head.next;
+  }
+  add_vector_temps(func->node);
+  func->alloca_bottom = alloca_bottom;
   func->locals = locals;
 
   leave_scope();
@@ -1274,7 +1788,7 @@ static Function *funcdef(Token **rest, Token *tok) {
 //             | ε
 // param = typespec declarator
 static Type *func_params(Token **rest, Token *tok, Type *ty) {
-  if (equal(tok, "void") && equal(tok->next, ")")) {
+  if (tok->id == KW_VOID && tok->next->id == ')') {
     *rest = tok->next;
     return func_returning(ty);
   }
@@ -1283,11 +1797,13 @@ static Type *func_params(Token **rest, Token *tok, Type *ty) {
   Type *cur = &head;
   bool is_variadic = false;
 
-  while (!equal(tok, ")")) {
+  // parameters are in scope for the array bounds of the ones after them
+  enter_scope();
+  while (tok->id != ')') {
     if (cur != &head)
-      tok =  skip(tok, ",");
+      tok =  skip_id(tok, ',');
 
-    if (consume(&tok, tok, "...")) {
+    if (consume_id(&tok, tok, OP_ELLIPSIS)) {
       is_variadic = true;
       break;
     }
@@ -1298,13 +1814,18 @@ static Type *func_params(Token **rest, Token *tok, Type *ty) {
     
     // "array of T" is converted to "pointer of T" only in parameter
     // context. example: *argv[] is converted to **argv by this.
-    if (ty2->kind == TY_ARRAY) {
+    if (ty2->kind == TY_ARRAY || ty2->kind == TY_VLA) {
       Token *name = ty2->ident;
       ty2 = pointer_to(ty2->base);
       ty2->ident = name;
     }
     cur = cur->next = copy_ty(ty2);
+    if (cur->ident) {
+      cur->param_var = new_var(get_identifier(cur->ident), cur);
+      push_scope(cur->param_var->name)->var = cur->param_var;
+    }
   }
+  leave_scope();
 
   ty = func_returning(ty);
   ty->params = head.next;
@@ -1319,11 +1840,13 @@ static Node *block_stmt(Token **rest, Token *tok) {
   Node head = {};
   Node *cur = &head;
   Token *start = tok;
+  Var *prev_vla_save = vla_save;
+  vla_save = NULL;
 
   enter_scope();
 
-  tok =  skip(tok, "{");
-  while (!consume(&tok, tok, "}")) {
+  tok =  skip_id(tok, '{');
+  while (!consume_id(&tok, tok, '}')) {
     if (is_typename(tok))
       cur = cur->next = declaration(&tok, tok);
     else
@@ -1336,6 +1859,8 @@ static Node *block_stmt(Token **rest, Token *tok) {
 
   Node *node = new_node(ND_BLOCK, start);
   node->body = head.next;
+  node->var = vla_save;
+  vla_save = prev_vla_save;
 
   *rest = tok;
   return node;
@@ -1358,71 +1883,75 @@ static Node *block_stmt(Token **rest, Token *tok) {
 static Node *stmt(Token **rest, Token *tok) {
   Node *node;
 
-  if (equal(tok, "if")) {
+  if (tok->id == KW_IF) {
     node = if_stmt(rest, tok);
     return node;
   }
 
-  if (equal(tok, "switch")) {
+  if (tok->id == KW_SWITCH) {
     node = switch_stmt(rest, tok);
     return node;
   }
 
-  if (equal(tok, "case")) {
+  if (tok->id == KW_CASE) {
     node = case_labeled_stmt(rest, tok);
     return node;
   }
 
-  if (equal(tok, "default")) {
+  if (tok->id == KW_DEFAULT) {
     node = default_labeled_stmt(rest, tok);
     return node;
   }
 
-  if (equal(tok, "while")) {
+  if (tok->id == KW_WHILE) {
     node = while_stmt(rest, tok);
     return node;
   }
 
-  if (equal(tok, "do")) {
+  if (tok->id == KW_DO) {
     node = do_stmt(rest, tok);
     return node;
   }
 
-  if (equal(tok, "for")) {
+  if (tok->id == KW_FOR) {
     node = for_stmt(rest, tok);
     return node;
   }
 
-  if (equal(tok, "break")) {
-    *rest = skip(tok->next, ";");
+  if (tok->id == KW_BREAK) {
+    *rest = skip_id(tok->next, ';');
     return new_node(ND_BREAK, tok);
   }
 
-  if (equal(tok, "continue")) {
-    *rest = skip(tok->next, ";");
+  if (tok->id == KW_CONTINUE) {
+    *rest = skip_id(tok->next, ';');
     return new_node(ND_CONTINUE, tok);
   }
 
-  if (equal(tok, "goto")) {
+  if (tok->id == KW_GOTO) {
     return goto_stmt(rest, tok);
   }
 
-  if (equal(tok, ";")) {
+  if (tok->id == KW_ASM) {
+    return asm_stmt(rest, tok);
+  }
+
+  if (tok->id == ';') {
     Node *node = new_node(ND_BLOCK, tok);
     *rest = tok->next;
     return node;
   }
 
-  if (tok->kind == TK_IDENT && equal(tok->next, ":")) {
+  if (tok->kind == TK_IDENT && tok->next->id == ':') {
     return labeled_stmt(rest, tok);
   }
 
-  if (equal(tok, "return")) {
+  if (tok->id == KW_RETURN) {
     node = return_stmt(rest, tok);
     return node;
   }
 
-  if (equal(tok, "{")) {
+  if (tok->id == '{') {
     node = block_stmt(rest, tok);
     return node;
   }
@@ -1436,31 +1965,40 @@ static Node *if_stmt(Token **rest, Token *tok) {
   Node *node;
   Token *start = tok;
 
-  tok =  skip(tok, "if");
+  tok =  skip_id(tok, KW_IF);
   node = new_node(ND_IF, start);
-  tok =  skip(tok, "(");
+  tok =  skip_id(tok, '(');
   node->cond = expr(&tok, tok);
-  tok =  skip(tok, ")");
+  tok =  skip_id(tok, ')');
   node->then = stmt(&tok, tok);
-  if (consume(&tok, tok, "else"))
+  if (consume_id(&tok, tok, KW_ELSE))
     node->els = stmt(&tok, tok);
 
   *rest = tok;
   return node;
 }
 
+// VLAs in the body of a loop or a switch are released by "break" and
+// "continue" too, which skip the end of the block that declares them
+static void add_vla_save(Node *node, int vlas) {
+  if (vla_count != vlas)
+    node->var = new_lvar("", pointer_to(ty_char));
+}
+
 // switch_stmt = "switch" "(" expr ")" stmt
 static Node *switch_stmt(Token **rest, Token *tok) {
   Node *node = new_node(ND_SWITCH, tok);
 
-  tok =  skip(tok, "switch");
-  tok =  skip(tok, "(");
+  tok =  skip_id(tok, KW_SWITCH);
+  tok =  skip_id(tok, '(');
   node->cond = expr(&tok, tok);
-  tok =  skip(tok, ")");
+  tok =  skip_id(tok, ')');
 
   Node *prev_sw = current_switch;
   current_switch = node;
+  int vlas = vla_count;
   node->then = stmt(rest, tok);
+  add_vla_save(node, vlas);
   current_switch = prev_sw;
   return node;
 }
@@ -1472,9 +2010,9 @@ static Node *case_labeled_stmt(Token **rest, Token *tok) {
 
   Node *node = new_node(ND_CASE, tok);
 
-  tok =  skip(tok, "case");
+  tok =  skip_id(tok, KW_CASE);
   int val = const_expr(&tok, tok);
-  tok =  skip(tok, ":");
+  tok =  skip_id(tok, ':');
   node->lhs = stmt(rest, tok);
   node->val = val;
   node->case_next = current_switch->case_next;
@@ -1489,8 +2027,8 @@ static Node *default_labeled_stmt(Token **rest, Token *tok) {
 
   Node *node = new_node(ND_CASE, tok);
 
-  tok =  skip(tok, "default");
-  tok =  skip(tok, ":");
+  tok =  skip_id(tok, KW_DEFAULT);
+  tok =  skip_id(tok, ':');
   node->lhs = stmt(rest, tok);
 
   current_switch->default_case = node;
@@ -1502,12 +2040,14 @@ static Node *while_stmt(Token **rest, Token *tok) {
   Node *node;
   Token *start = tok;
 
-  tok =  skip(tok, "while");
+  tok =  skip_id(tok, KW_WHILE);
   node = new_node(ND_FOR, start);
-  tok =  skip(tok, "(");
+  tok =  skip_id(tok, '(');
   node->cond = expr(&tok, tok);
-  tok =  skip(tok, ")");
+  tok =  skip_id(tok, ')');
+  int vlas = vla_count;
   node->then = stmt(&tok, tok);
+  add_vla_save(node, vlas);
 
   *rest = tok;
   return node;
@@ -1515,16 +2055,18 @@ static Node *while_stmt(Token **rest, Token *tok) {
 
 // do_stmt = "do" stmt "while" "(" expr ")" ";"
 static Node *do_stmt(Token **rest, Token *tok) {
-  tok =  skip(tok, "do");
+  tok =  skip_id(tok, KW_DO);
 
   Node *node = new_node(ND_DO, tok);
+  int vlas = vla_count;
   node->then = stmt(&tok, tok);
+  add_vla_save(node, vlas);
 
-  tok = skip(tok, "while");
-  tok = skip(tok, "(");
+  tok = skip_id(tok, KW_WHILE);
+  tok = skip_id(tok, '(');
   node->cond = expr(&tok, tok);
-  tok = skip(tok, ")");
-  *rest = skip(tok, ";");
+  tok = skip_id(tok, ')');
+  *rest = skip_id(tok, ';');
 
   return node;
 }
@@ -1534,42 +2076,244 @@ static Node *for_stmt(Token **rest, Token *tok) {
   Node *node;
   Token *start = tok;
 
-  tok =  skip(tok, "for");
+  tok =  skip_id(tok, KW_FOR);
   node = new_node(ND_FOR, start);
-  tok =  skip(tok, "(");
+  tok =  skip_id(tok, '(');
 
   enter_scope();
 
   if (is_typename(tok)) {
     node->init = declaration(&tok, tok);
   } else {
-    if(!consume(&tok, tok, ";")) {
+    if(!consume_id(&tok, tok, ';')) {
       node->init = new_node_unary(ND_EXPR_STMT, expr(&tok, tok), tok);
-      tok =  skip(tok, ";");
+      tok =  skip_id(tok, ';');
     }
   }
-  if(!consume(&tok, tok, ";")) {
+  if(!consume_id(&tok, tok, ';')) {
     node->cond = expr(&tok, tok);
-    tok =  skip(tok, ";");
+    tok =  skip_id(tok, ';');
   }
-  if(!consume(&tok, tok, ")")) {
+  if(!consume_id(&tok, tok, ')')) {
     node->inc = new_node_unary(ND_EXPR_STMT, expr(&tok, tok), tok);
-    tok =  skip(tok, ")");
+    tok =  skip_id(tok, ')');
   }
+  int vlas = vla_count;
   node->then = stmt(&tok, tok);
+  add_vla_save(node, vlas);
   leave_scope();
 
   *rest = tok;
   return node;
 }
 
-// goto-stmt = "goto" ident ";"
+// goto-stmt = "goto" (ident | "*" expr) ";"
 static Node *goto_stmt(Token **rest, Token *tok) {
-  Node *node = new_node(ND_GOTO, tok);
+  Token *start = tok;
+  tok =  skip_id(tok, KW_GOTO);
+
+  // computed goto: jump to a label address taken by "&&"
+  if (consume_id(&tok, tok, '*')) {
+    Node *node = new_node(ND_GOTO_EXPR, start);
+    node->lhs = expr(&tok, tok);
+    *rest = skip_id(tok, ';');
+    return node;
+  }
 
-  tok =  skip(tok, "goto");
+  Node *node = new_node(ND_GOTO, start);
   node->label_name = expect_ident(&tok, tok);
-  *rest =  skip(tok, ";");
+  *rest =  skip_id(tok, ';');
+  return node;
+}
+
+// reduces an operand constraint to a single letter (see AsmOperand).
+// among alternatives (e.g. "rm", "ri") the first one recognized wins.
+static char asm_constraint_kind(Token *tok, char *cons, int *match) {
+  *match = -1;
+
+  for (char *p = cons; *p; p++) {
+    if (strchr("=+&%", *p))
+      continue;
+    if (isdigit(*p)) {
+      *match = strtol(p, &p, 10);
+      return 0;
+    }
+    if (strchr("abcdSD", *p))
+      return *p;
+    if (strchr("rqgR", *p))
+      return 'r';
+    if (*p == 'x' || *p == 'v')
+      return 'x';
+    if (strchr("moV", *p))
+      return 'm';
+    if (*p == 'i' || *p == 'n')
+      return 'i';
+  }
+  error_tok(tok, "unsupported asm constraint");
+}
+
+static char *asm_string(Token **rest, Token *tok) {
+  if (tok->kind != TK_STR)
+    error_tok(tok, "expected a string literal");
+  *rest = tok->next;
+  return token_lit(tok)->contents;
+}
+
+// chains `expr` to the operand setup expression evaluated before the asm
+static void add_asm_init(Node **init, Node *expr, Token *tok) {
+  generate_type(expr);
+  *init = *init ? new_node_binary(ND_COMMA, *init, expr, tok) : expr;
+}
+
+static Var *new_asm_temp(Node **init, Type *ty, Node *expr, Token *tok) {
+  Var *var = new_lvar("", ty);
+  add_asm_init(init, new_node_binary(ND_ASSIGN, new_node_var(var, tok), expr, tok), tok);
+  return var;
+}
+
+// asm-operand = ("[" ident "]")? string-literal "(" expr ")"
+static AsmOperand *asm_operand(Token **rest, Token *tok, bool is_output,
+                               AsmOperand *outputs, Node **init) {
+  AsmOperand *op = calloc(1, sizeof(AsmOperand));
+  op->is_output = is_output;
+
+  if (consume_id(&tok, tok, '[')) {
+    op->name = expect_ident(&tok, tok);
+    tok = skip_id(tok, ']');
+  }
+
+  Token *start = tok;
+  char *cons = asm_string(&tok, tok);
+  op->kind = asm_constraint_kind(start, cons, &op->match);
+
+  if (op->match >= 0) {
+    if (is_output)
+      error_tok(start, "matching constraint is not allowed for an output");
+
+    AsmOperand *out = outputs;
+    for (int i = 0; out && i < op->match; i++)
+      out = out->next;
+    if (!out)
+      error_tok(start, "matching constraint references an invalid operand");
+    if (out->kind == 'm')
+      error_tok(start, "matching constraint references a memory operand");
+    op->kind = out->kind;
+  }
+
+  tok = skip_id(tok, '(');
+  Node *node = expr(&tok, tok);
+  *rest = skip_id(tok, ')');
+  generate_type(node);
+
+  op->ty = node->ty;
+  if (op->ty->kind == TY_ARRAY && !is_output)
+    op->ty = pointer_to(op->ty->base);
+
+  if (op->kind == 'i') {
+    if (is_output)
+      error_tok(start, "immediate constraint is not allowed for an output");
+    op->imm = eval(node);
+    return op;
+  }
+
+  if (op->kind == 'm') {
+    op->ptr = new_asm_temp(init, pointer_to(op->ty), new_node_unary(ND_ADDR, node, start), start);
+    return op;
+  }
+
+  int sz = size_of(op->ty);
+  if (op->kind == 'x' ? (sz != 4 && sz != 8) : (sz != 1 && sz != 2 && sz != 4 && sz != 8))
+    error_tok(start, "unsupported asm operand type");
+
+  if (!is_output) {
+    op->val = new_asm_temp(init, op->ty, node, start);
+    return op;
+  }
+
+  op->ptr = new_asm_temp(init, pointer_to(op->ty), new_node_unary(ND_ADDR, node, start), start);
+
+  // "+": read-write operand is loaded with the current value
+  if (strchr(cons, '+'))
+    op->val = new_asm_temp(init, op->ty, new_node_unary(ND_DEREF, new_node_var(op->ptr, start), start), start);
+  return op;
+}
+
+// asm-operands = (asm-operand ("," asm-operand)*)?
+static AsmOperand *asm_operands(Token **rest, Token *tok, bool is_output,
+                                AsmOperand *outputs, Node **init) {
+  AsmOperand head = {};
+  AsmOperand *cur = &head;
+
+  while (tok->id != ':' && tok->id != ')') {
+    if (cur != &head)
+      tok = skip_id(tok, ',');
+    cur = cur->next = asm_operand(&tok, tok, is_output, outputs, init);
+  }
+  *rest = tok;
+  return head.next;
+}
+
+// asm-stmt = "asm" ("volatile" | "inline")* "(" string-literal
+//            (":" asm-operands (":" asm-operands (":" clobbers)?)?)? ")" ";"
+// clobbers = (string-literal ("," string-literal)*)?
+//
+// operand values and output addresses are evaluated into temporaries
+// (node->lhs) before the asm, so that codegen only has to move them
+// between the frame and the assigned registers.
+static Node *asm_stmt(Token **rest, Token *tok) {
+  Node *node = new_node(ND_ASM, tok);
+  tok = skip_id(tok, KW_ASM);
+
+  while (tok->id == KW_VOLATILE || equal(tok, "inline"))
+    tok = tok->next;
+  if (tok->id == KW_GOTO)
+    error_tok(tok, "asm goto is not supported");
+
+  tok = skip_id(tok, '(');
+  node->asm_str = asm_string(&tok, tok);
+  node->asm_is_basic = tok->id != ':';
+
+  AsmOperand *outputs = NULL;
+  AsmOperand *inputs = NULL;
+  Node *init = NULL;
+
+  if (consume_id(&tok, tok, ':')) {
+    outputs = asm_operands(&tok, tok, true, NULL, &init);
+
+    if (consume_id(&tok, tok, ':'))
+      inputs = asm_operands(&tok, tok, false, outputs, &init);
+
+    int nclobbers = 0;
+    node->asm_clobbers = calloc(1, sizeof(char *));
+    if (consume_id(&tok, tok, ':')) {
+      while (tok->id != ')') {
+        if (nclobbers)
+          tok = skip_id(tok, ',');
+        node->asm_clobbers = realloc(node->asm_clobbers, sizeof(char *) * (nclobbers + 2));
+        node->asm_clobbers[nclobbers++] = asm_string(&tok, tok);
+        node->asm_clobbers[nclobbers] = NULL;
+      }
+    }
+  }
+  tok = skip_id(tok, ')');
+  *rest = skip_id(tok, ';');
+
+  // outputs followed by inputs
+  AsmOperand **cur = &outputs;
+  int nops = 0;
+  while (*cur) {
+    cur = &(*cur)->next;
+    nops++;
+  }
+  *cur = inputs;
+  for (AsmOperand *op = inputs; op; op = op->next)
+    nops++;
+
+  if (nops > 30)
+    error_tok(node->token, "too many asm operands");
+
+  node->asm_ops = outputs;
+  node->lhs = init;
   return node;
 }
 
@@ -1578,8 +2322,10 @@ static Node *labeled_stmt(Token **rest, Token *tok) {
   Node *node = new_node(ND_LABEL, tok);
 
   node->label_name = expect_ident(&tok, tok);
-  tok =  skip(tok, ":");
+  tok =  skip_id(tok, ':');
   node->lhs = stmt(rest, tok);
+  node->label_next = labels;
+  labels = node;
   return node;
 }
 
@@ -1587,12 +2333,12 @@ static Node *labeled_stmt(Token **rest, Token *tok) {
 static Node *return_stmt(Token **rest, Token *tok) {
   Node *node = new_node(ND_RETURN, tok);
 
-  tok =  skip(tok, "return");
-  if (consume(rest, tok, ";"))
+  tok =  skip_id(tok, KW_RETURN);
+  if (consume_id(rest, tok, ';'))
     return node;
 
   Node *exp = expr(&tok, tok);
-  *rest =  skip(tok, ";");
+  *rest =  skip_id(tok, ';');
 
   generate_type(exp);
   node->lhs = new_node_cast(exp, current_fn->ty->return_ty);
@@ -1605,7 +2351,7 @@ static Node *expr_stmt(Token **rest, Token *tok) {
   Token *start = tok;
 
   node = new_node_unary(ND_EXPR_STMT, expr(&tok, tok), start);
-  tok =  skip(tok, ";");
+  tok =  skip_id(tok, ';');
 
   *rest = tok;
   return node;
@@ -1617,7 +2363,7 @@ static Node *expr(Token **rest, Token *tok) {
 
   // supporting "generized lvalue" supported by past GCC (already deprecated)
   // implemeted for convenient use
-  if (consume(&tok, tok, ","))
+  if (consume_id(&tok, tok, ','))
     node = new_node_binary(ND_COMMA, node, expr(&tok, tok), tok);
 
   *rest = tok;
@@ -1717,12 +2463,18 @@ static long eval2(Node *node, Var **var) {
     case ND_NUM:
       return node->val;
     case ND_ADDR:
-      if (!var || *var || node->lhs->kind != ND_VAR || node->lhs->var->is_local)
+      // the address of a thread-local variable is not a link-time constant
+      if (!var || *var || node->lhs->kind != ND_VAR || node->lhs->var->is_local || node->lhs->var->is_tls)
         error_tok(node->token, "invalid initializer");
       *var = node->lhs->var;
       return 0;
     case ND_VAR:
-      if (!var || *var || node->var->ty->kind != TY_ARRAY)
+      if (!var || *var || node->var->ty->kind != TY_ARRAY || node->var->is_tls)
+        error_tok(node->token, "invalid initializer");
+      *var = node->var;
+      return 0;
+    case ND_LABEL_VAL:
+      if (!var || *var)
         error_tok(node->token, "invalid initializer");
       *var = node->var;
       return 0;
@@ -1769,12 +2521,105 @@ long const_expr(Token **rest, Token *tok) {
   return eval(node);
 }
 
+// the unqualified version of an atomic type, for temporaries
+static Type *non_atomic(Type *ty) {
+  if (!ty->is_atomic)
+    return ty;
+  ty = copy_ty(ty);
+  ty->is_atomic = false;
+  return ty;
+}
+
+static Node *new_cas(Node *addr, Node *old, Node *new, Token *tok) {
+  Node *node = new_node(ND_CAS, tok);
+  node->cas_addr = addr;
+  node->cas_old = old;
+  node->cas_new = new;
+  return node;
+}
+
+// atomic read-modify-write `*ptr = *ptr op rhs`, evaluated to either the old
+// or the new value. addition and subtraction of integers (and of pointers,
+// with rhs already scaled) is a single `lock xadd`:
+//
+//   (addr = ptr, val = rhs, FETCH_ADD(addr, +/-val) [+/- val])
+//
+// anything else is a compare-and-swap loop:
+//
+//   ({ addr = ptr; val = rhs; old = *addr;
+//      do new = old op val; while (!CAS(addr, &old, new));
+//      old or new; })
+static Node *atomic_rmw(Node *ptr, Node *rhs, NodeKind op, bool return_old, Token *tok) {
+  generate_type(ptr);
+  generate_type(rhs);
+  if (!ptr->ty->base)
+    error_tok(tok, "pointer expected");
+
+  Type *ty = non_atomic(ptr->ty->base);
+  Var *addr = new_lvar("", pointer_to(ty));
+  Node *init = new_node_binary(ND_ASSIGN, new_node_var(addr, tok), ptr, tok);
+
+  if ((op == ND_ADD || op == ND_SUB) && (is_integer(ty) || ty->kind == TY_PTR)) {
+    Type *val_ty = (ty->kind == TY_PTR) ? ty_long : ty;
+    Var *val = new_lvar("", val_ty);
+    init = new_node_binary(ND_COMMA, init,
+                           new_node_binary(ND_ASSIGN, new_node_var(val, tok), new_node_cast(rhs, val_ty), tok),
+                           tok);
+
+    Node *delta = new_node_var(val, tok);
+    if (op == ND_SUB)
+      delta = new_node_cast(new_node_binary(ND_SUB, new_node_num(0, tok), delta, tok), val_ty);
+
+    Node *node = new_node_binary(ND_FETCH_ADD, new_node_var(addr, tok), delta, tok);
+    if (!return_old)
+      node = new_node_cast(new_node_binary(op, new_node_cast(node, val_ty), new_node_var(val, tok), tok), ty);
+    return new_node_binary(ND_COMMA, init, node, tok);
+  }
+
+  Var *val = new_lvar("", non_atomic(rhs->ty));
+  Var *old = new_lvar("", ty);
+  Var *new = new_lvar("", ty);
+
+  Node head = {};
+  Node *cur = &head;
+  cur = cur->next = new_node_unary(ND_EXPR_STMT, init, tok);
+  cur = cur->next = new_node_unary(ND_EXPR_STMT,
+                                   new_node_binary(ND_ASSIGN, new_node_var(val, tok), rhs, tok), tok);
+  cur = cur->next = new_node_unary(ND_EXPR_STMT,
+                                   new_node_binary(ND_ASSIGN, new_node_var(old, tok),
+                                                   new_node_unary(ND_DEREF, new_node_var(addr, tok), tok),
+                                                   tok),
+                                   tok);
+
+  Node *loop = new_node(ND_DO, tok);
+  loop->then = new_node_unary(ND_EXPR_STMT,
+                              new_node_binary(ND_ASSIGN, new_node_var(new, tok),
+                                              new_node_binary(op, new_node_var(old, tok), new_node_var(val, tok), tok),
+                                              tok),
+                              tok);
+  loop->cond = new_node_unary(ND_NOT,
+                              new_cas(new_node_var(addr, tok),
+                                      new_node_unary(ND_ADDR, new_node_var(old, tok), tok),
+                                      new_node_var(new, tok), tok),
+                              tok);
+  cur = cur->next = loop;
+  cur = cur->next = new_node_unary(ND_EXPR_STMT, new_node_var(return_old ? old : new, tok), tok);
+
+  Node *node = new_node(ND_STMT_EXPR, tok);
+  node->body = head.next;
+  return node;
+}
+
 // Convert 'A op= B' to 'tmp = &A, *tmp = *tmp op B'
 // where tmp is a fresh pointer variable.
 static Node *to_assign(Node *binary) {
   generate_type(binary->lhs);
   generate_type(binary->rhs);
 
+  if (binary->lhs->ty->is_atomic)
+    return atomic_rmw(new_node_unary(ND_ADDR, binary->lhs, binary->token),
+                      binary->rhs, binary->kind, false, binary->token);
+
   Var *var = new_lvar("", pointer_to(binary->lhs->ty));
   Token *tok = binary->token;
 
@@ -1795,37 +2640,37 @@ static Node *to_assign(Node *binary) {
 static Node *assign(Token **rest, Token *tok) {
   Node *node = conditional(&tok, tok);
 
-  if (consume(&tok, tok, "="))
+  if (consume_id(&tok, tok, '='))
     return new_node_binary(ND_ASSIGN, node, assign(rest, tok), tok);
 
-  if (consume(&tok, tok, "+="))
+  if (consume_id(&tok, tok, OP_ADD_ASSIGN))
     return to_assign(new_node_add(node, assign(rest, tok), tok));
 
-  if (consume(&tok, tok, "-="))
+  if (consume_id(&tok, tok, OP_SUB_ASSIGN))
     return to_assign(new_node_sub(node, assign(rest, tok), tok));
 
-  if (consume(&tok, tok, "*="))
+  if (consume_id(&tok, tok, OP_MUL_ASSIGN))
     return to_assign(new_node_binary(ND_MUL, node, assign(rest, tok), tok));
 
-  if (consume(&tok, tok, "/="))
+  if (consume_id(&tok, tok, OP_DIV_ASSIGN))
     return to_assign(new_node_binary(ND_DIV, node, assign(rest, tok), tok));
 
-  if (consume(&tok, tok, "%="))
+  if (consume_id(&tok, tok, OP_MOD_ASSIGN))
     return to_assign(new_node_binary(ND_MOD, node, assign(rest, tok), tok));
 
-  if (consume(&tok, tok, "&="))
+  if (consume_id(&tok, tok, OP_AND_ASSIGN))
     return to_assign(new_node_binary(ND_BITAND, node, assign(rest, tok), tok));
 
-  if (consume(&tok, tok, "|="))
+  if (consume_id(&tok, tok, OP_OR_ASSIGN))
     return to_assign(new_node_binary(ND_BITOR, node, assign(rest, tok), tok));
 
-  if (consume(&tok, tok, "^="))
+  if (consume_id(&tok, tok, OP_XOR_ASSIGN))
     return to_assign(new_node_binary(ND_BITXOR, node, assign(rest, tok), tok));
 
-  if (consume(&tok, tok, "<<="))
+  if (consume_id(&tok, tok, OP_SHL_ASSIGN))
     return to_assign(new_node_binary(ND_SHL, node, assign(rest, tok), tok));
 
-  if (consume(&tok, tok, ">>="))
+  if (consume_id(&tok, tok, OP_SHR_ASSIGN))
     return to_assign(new_node_binary(ND_SHR, node, assign(rest, tok), tok));
 
   *rest = tok;
@@ -1836,7 +2681,7 @@ static Node *assign(Token **rest, Token *tok) {
 static Node *conditional(Token **rest, Token *tok) {
   Node *node = logor(&tok, tok);
 
-  if (!equal(tok, "?")) {
+  if (tok->id != '?') {
     *rest = tok;
     return node;
   }
@@ -1844,7 +2689,7 @@ static Node *conditional(Token **rest, Token *tok) {
   Node *cond = new_node(ND_COND, tok);
   cond->cond = node;
   cond->then = expr(&tok, tok->next);
-  tok = skip(tok, ":");
+  tok = skip_id(tok, ':');
   cond->els = conditional(rest, tok);
 
   return cond;
@@ -1853,7 +2698,7 @@ static Node *conditional(Token **rest, Token *tok) {
 // logor  = logand ("||" logand)*
 static Node *logor(Token **rest, Token *tok) {
   Node *node = logand(&tok, tok);
-  while (consume(&tok, tok, "||")) {
+  while (consume_id(&tok, tok, OP_LOGOR)) {
     Token *start = tok;
     node = new_node_binary(ND_LOGOR, node, logand(&tok, tok), start);
   }
@@ -1864,7 +2709,7 @@ static Node *logor(Token **rest, Token *tok) {
 // logand = bitor ("&&" bitor)*
 static Node *logand(Token **rest, Token *tok) {
   Node *node = bitor(&tok, tok);
-  while (consume(&tok, tok, "&&")) {
+  while (consume_id(&tok, tok, OP_LOGAND)) {
     Token *start = tok;
     node = new_node_binary(ND_LOGAND, node, bitor(&tok, tok), start);
   }
@@ -1875,7 +2720,7 @@ static Node *logand(Token **rest, Token *tok) {
 // bitor  = bitxor ("|" bitxor)*
 static Node *bitor(Token **rest, Token *tok) {
   Node *node = bitxor(&tok, tok);
-  while (consume(&tok, tok, "|")) {
+  while (consume_id(&tok, tok, '|')) {
     Token *start = tok;
     node = new_node_binary(ND_BITOR, node, bitxor(&tok, tok), start);
   }
@@ -1886,7 +2731,7 @@ static Node *bitor(Token **rest, Token *tok) {
 // bitxor  = bitand ("^" bitand)*
 static Node *bitxor(Token **rest, Token *tok) {
   Node *node = bitand(&tok, tok);
-  while (consume(&tok, tok, "^")) {
+  while (consume_id(&tok, tok, '^')) {
     Token *start = tok;
     node = new_node_binary(ND_BITXOR, node, bitand(&tok, tok), start);
   }
@@ -1897,7 +2742,7 @@ static Node *bitxor(Token **rest, Token *tok) {
 // bitand  = equality ("^" equality)*
 static Node *bitand(Token **rest, Token *tok) {
   Node *node = equality(&tok, tok);
-  while (consume(&tok, tok, "&")) {
+  while (consume_id(&tok, tok, '&')) {
     Token *start = tok;
     node = new_node_binary(ND_BITAND, node, equality(&tok, tok), start);
   }
@@ -1911,11 +2756,11 @@ static Node *equality(Token **rest, Token *tok) {
   Token *start = tok;
 
   for(;;) {
-    if (consume(&tok, tok, "==")) {
+    if (consume_id(&tok, tok, OP_EQ)) {
       node = new_node_binary(ND_EQ, node, relational(&tok, tok), start);
       continue;
     }
-    if (consume(&tok, tok, "!=")) {
+    if (consume_id(&tok, tok, OP_NE)) {
       node = new_node_binary(ND_NE, node, relational(&tok, tok), start);
       continue;
     }
@@ -1931,19 +2776,19 @@ static Node *relational(Token **rest, Token *tok) {
   Token *start = tok;
 
   for(;;) {
-    if (consume(&tok, tok, "<")) {
+    if (consume_id(&tok, tok, '<')) {
       node = new_node_binary(ND_LT, node, shift(&tok, tok), start);
       continue;
     }
-    if (consume(&tok, tok, "<=")) {
+    if (consume_id(&tok, tok, OP_LE)) {
       node = new_node_binary(ND_LE, node, shift(&tok, tok), start);
       continue;
     }
-    if (consume(&tok, tok, ">")) {
+    if (consume_id(&tok, tok, '>')) {
       node = new_node_binary(ND_LT, shift(&tok, tok), node, start);
       continue;
     }
-    if (consume(&tok, tok, ">=")) {
+    if (consume_id(&tok, tok, OP_GE)) {
       node = new_node_binary(ND_LE, shift(&tok, tok), node, start);
       continue;
     }
@@ -1960,11 +2805,11 @@ static Node *shift(Token **rest, Token *tok) {
   for(;;) {
     Token *start = tok;
 
-    if (consume(&tok, tok, "<<")) {
+    if (consume_id(&tok, tok, OP_SHL)) {
       node = new_node_binary(ND_SHL, node, add(&tok, tok), start);
       continue;
     }
-    if (consume(&tok, tok, ">>")) {
+    if (consume_id(&tok, tok, OP_SHR)) {
       node = new_node_binary(ND_SHR, node, add(&tok, tok), start);
       continue;
     }
@@ -1980,11 +2825,11 @@ static Node *add(Token **rest, Token *tok) {
   Token *start = tok;
 
   for(;;) {
-    if (consume(&tok, tok, "+")) {
+    if (consume_id(&tok, tok, '+')) {
       node = new_node_add(node, mul(&tok, tok), start);
       continue;
     }
-    if (consume(&tok, tok, "-")) {
+    if (consume_id(&tok, tok, '-')) {
       node = new_node_sub(node, mul(&tok, tok), start);
       continue;
     }
@@ -2000,15 +2845,15 @@ static Node *mul(Token **rest, Token *tok) {
   Token *start = tok;
 
   for(;;) {
-    if (consume(&tok, tok, "*")) {
+    if (consume_id(&tok, tok, '*')) {
       node = new_node_binary(ND_MUL, node, cast(&tok, tok), start);
       continue;
     }
-    else if (consume(&tok, tok, "/")) {
+    else if (consume_id(&tok, tok, '/')) {
       node = new_node_binary(ND_DIV, node, cast(&tok, tok), start);
       continue;
     }
-    if (consume(&tok, tok, "%")) {
+    if (consume_id(&tok, tok, '%')) {
       node = new_node_binary(ND_MOD, node, cast(&tok, tok), start);
       continue;
     }
@@ -2036,12 +2881,12 @@ static Node *compound_literal(Token **rest, Token *tok, Type *ty, Token *start)
 //      | "(" typename ")" cast
 //      | unary
 static Node *cast(Token **rest, Token *tok) {
-  if (equal(tok, "(") && is_typename(tok->next)) {
+  if (tok->id == '(' && is_typename(tok->next)) {
     Token *start = tok;
     Type *ty = typename(&tok, tok->next);
-    tok = skip(tok, ")");
+    tok = skip_id(tok, ')');
 
-    if (equal(tok, "{"))
+    if (tok->id == '{')
       return compound_literal(rest, tok, ty, start);
 
     Node *node = new_node_unary(ND_CAST, cast(rest, tok), tok);
@@ -2054,35 +2899,60 @@ static Node *cast(Token **rest, Token *tok) {
   return unary(rest, tok);
 }
 
+// a pseudo-variable that stands for the address of a label in the current
+// function, so that "&&label" can appear in static initializers as a relocation
+static Var *new_label_var(char *label) {
+  Var *var = calloc(1, sizeof(Var));
+  var->name = malloc(strlen(current_fn->name) + strlen(label) + 11);
+  sprintf(var->name, ".L.label.%s.%s", current_fn->name, label);
+  var->ty = pointer_to(ty_void);
+  return var;
+}
+
 // unary = ("+" | "-" | "*" | "&" | "!" | "~") cast
 //       | ("++" | "--") unary
 //       | postfix
 static Node *unary(Token **rest, Token *tok) {
   Token *start = tok;
 
-  if (equal(tok, "+"))
+  if (tok->id == '+')
     return cast(rest, tok->next);
-  if (equal(tok, "-"))
+  if (tok->id == '-')
     return new_node_binary(ND_SUB, new_node_num(0, start), cast(rest, tok->next), start);
-  if (equal(tok, "&"))
+  if (tok->id == '&')
     return new_node_unary(ND_ADDR, cast(rest, tok->next), start);
-  if (equal(tok, "*"))
+  if (tok->id == '*')
     return new_node_unary(ND_DEREF, cast(rest, tok->next), start);
-  if (equal(tok, "!"))
+  if (tok->id == '!')
     return new_node_unary(ND_NOT, cast(rest, tok->next), start);
-  if (equal(tok, "~"))
+  if (tok->id == '~')
     return new_node_unary(ND_BITNOT, cast(rest, tok->next), start);
-  if (equal(tok, "++"))
+
+  // labels-as-values: "&&" ident
+  if (tok->id == OP_LOGAND) {
+    if (!current_fn)
+      error_tok(tok, "label address outside a function");
+    Node *node = new_node(ND_LABEL_VAL, start);
+    node->label_name = get_identifier(tok->next);
+    node->var = new_label_var(node->label_name);
+    node->label_next = label_vals;
+    label_vals = node;
+    *rest = tok->next->next;
+    return node;
+  }
+
+  if (tok->id == OP_INC)
     return to_assign(new_node_add(unary(rest, tok->next), new_node_num(1, tok), tok));
-  if (equal(tok, "--"))
+  if (tok->id == OP_DEC)
     return to_assign(new_node_sub(unary(rest, tok->next), new_node_num(1, tok), tok));
 
   return postfix(rest, tok);
 }
 
 static Member *get_struct_member(Type *ty, Token *tok) {
+  char *name = get_identifier(tok);
   for (Member *mem = ty->members; mem; mem = mem->next)
-    if (!strncmp(mem->name, tok->str, tok->len))
+    if (mem->name == name)
       return mem;
   error_tok(tok, "no such member");
 }
@@ -2102,6 +2972,12 @@ static Node *struct_ref(Token **rest, Token *tok, Node *lhs) {
 static Node *new_inc_dec(Node *node, Token *tok, int addend) {
   generate_type(node);
 
+  if (node->ty->is_atomic) {
+    if (node->ty->kind == TY_PTR)
+      addend *= size_of(node->ty->base);
+    return atomic_rmw(new_node_unary(ND_ADDR, node, tok), new_node_num(addend, tok), ND_ADD, true, tok);
+  }
+
   Var *var = new_lvar("", pointer_to(node->ty));
 //  Token *tok = binary->token;
 
@@ -2136,38 +3012,37 @@ static Node *postfix(Token **rest, Token *tok) {
   Node *node = primary(&tok, tok);
 
   for (;;) {
-    if (equal(tok, "("))  {
+    if (tok->id == '(')  {
       node = funcall(&tok, tok, node);
       continue;
     }
 
-    if (consume(&tok, tok, "["))  {
-      // x[y] is syntax sugar for *(x + y)
+    if (consume_id(&tok, tok, '['))  {
       Node *idx = expr(&tok, tok);
-      tok =  skip(tok, "]");
-      node = new_node_unary(ND_DEREF, new_node_add(node, idx, start), start);
+      tok =  skip_id(tok, ']');
+      node = new_subscript(node, idx, start);
       continue;
     }
 
-    if (consume(&tok, tok, ".")) {
+    if (consume_id(&tok, tok, '.')) {
       node = struct_ref(&tok, tok, node);
       expect_ident(&tok, tok);
       continue;
     }
 
-    if (consume(&tok, tok, "->")) {
+    if (consume_id(&tok, tok, OP_ARROW)) {
       node = new_node_unary(ND_DEREF, node, start);
       node = struct_ref(&tok, tok, node);
       expect_ident(&tok, tok);
       continue;
     }
 
-    if (consume(&tok, tok, "++")) {
+    if (consume_id(&tok, tok, OP_INC)) {
       node = new_inc_dec(node, tok, 1);
       continue;
     }
 
-    if (consume(&tok, tok, "--")) {
+    if (consume_id(&tok, tok, OP_DEC)) {
       node = new_inc_dec(node, tok, -1);
       continue;
     }
@@ -2177,6 +3052,311 @@ static Node *postfix(Token **rest, Token *tok) {
   }
 }
 
+// reads "(" assign ("," assign)* ")" with exactly `n` arguments
+static void builtin_args(Token **rest, Token *tok, Node **args, int n) {
+  tok = skip_id(tok, '(');
+  for (int i = 0; i < n; i++) {
+    if (i > 0)
+      tok = skip_id(tok, ',');
+    args[i] = assign(&tok, tok);
+    generate_type(args[i]);
+  }
+  *rest = skip_id(tok, ')');
+}
+
+static Type *atomic_base(Node *ptr) {
+  if (!ptr->ty->base)
+    error_tok(ptr->token, "pointer expected");
+  return non_atomic(ptr->ty->base);
+}
+
+// a plain store has release semantics on x86; only a seq_cst store needs `xchg`.
+// an order that isn't a constant is taken as seq_cst
+static bool is_seq_cst(Node *order) {
+  return !is_const_expr(order) || eval(order) == 5;
+}
+
+static Node *new_exch(Node *ptr, Node *val, Token *tok) {
+  return new_node_binary(ND_EXCH, ptr, new_node_cast(val, atomic_base(ptr)), tok);
+}
+
+static struct {
+  char *name;
+  NodeKind op;
+  bool return_old;
+} atomic_rmw_builtins[] = {
+  {"__atomic_fetch_add", ND_ADD, true},
+  {"__atomic_fetch_sub", ND_SUB, true},
+  {"__atomic_fetch_and", ND_BITAND, true},
+  {"__atomic_fetch_or", ND_BITOR, true},
+  {"__atomic_fetch_xor", ND_BITXOR, true},
+  {"__atomic_add_fetch", ND_ADD, false},
+  {"__atomic_sub_fetch", ND_SUB, false},
+  {"__atomic_and_fetch", ND_BITAND, false},
+  {"__atomic_or_fetch", ND_BITOR, false},
+  {"__atomic_xor_fetch", ND_BITXOR, false},
+  {"__sync_fetch_and_add", ND_ADD, true},
+  {"__sync_fetch_and_sub", ND_SUB, true},
+  {"__sync_fetch_and_and", ND_BITAND, true},
+  {"__sync_fetch_and_or", ND_BITOR, true},
+  {"__sync_fetch_and_xor", ND_BITXOR, true},
+  {"__sync_add_and_fetch", ND_ADD, false},
+  {"__sync_sub_and_fetch", ND_SUB, false},
+  {"__sync_and_and_fetch", ND_BITAND, false},
+  {"__sync_or_and_fetch", ND_BITOR, false},
+  {"__sync_xor_and_fetch", ND_BITXOR, false},
+};
+
+// GNU __atomic and __sync builtins. returns NULL if `tok` is not one of them.
+//
+// on x86-64 every locked instruction (and xchg) is a full barrier and plain
+// loads are acquire loads, so the memory order only matters for stores
+// and fences, where anything weaker than seq_cst needs no extra instruction.
+static Node *atomic_builtin(Token **rest, Token *tok) {
+  Token *start = tok;
+  Node *args[6];
+
+  for (int i = 0; i < sizeof(atomic_rmw_builtins) / sizeof(*atomic_rmw_builtins); i++) {
+    if (!equal(tok, atomic_rmw_builtins[i].name))
+      continue;
+    builtin_args(rest, tok->next, args, strncmp(tok->str, "__atomic", 8) ? 2 : 3);
+    // GCC does not scale the operand for pointers
+    return atomic_rmw(args[0], args[1], atomic_rmw_builtins[i].op, atomic_rmw_builtins[i].return_old, start);
+  }
+
+  if (equal(tok, "__atomic_load_n")) {
+    builtin_args(rest, tok->next, args, 2);
+    return new_node_unary(ND_DEREF, new_node_cast(args[0], pointer_to(atomic_base(args[0]))), start);
+  }
+
+  if (equal(tok, "__atomic_store_n")) {
+    builtin_args(rest, tok->next, args, 3);
+    if (is_seq_cst(args[2]))
+      return new_node_cast(new_exch(args[0], args[1], start), ty_void);
+
+    Node *lhs = new_node_unary(ND_DEREF, new_node_cast(args[0], pointer_to(atomic_base(args[0]))), start);
+    return new_node_cast(new_node_binary(ND_ASSIGN, lhs, args[1], start), ty_void);
+  }
+
+  if (equal(tok, "__atomic_exchange_n")) {
+    builtin_args(rest, tok->next, args, 3);
+    return new_exch(args[0], args[1], start);
+  }
+
+  if (equal(tok, "__sync_lock_test_and_set")) {
+    builtin_args(rest, tok->next, args, 2);
+    return new_exch(args[0], args[1], start);
+  }
+
+  if (equal(tok, "__sync_lock_release")) {
+    builtin_args(rest, tok->next, args, 1);
+    Node *lhs = new_node_unary(ND_DEREF, new_node_cast(args[0], pointer_to(atomic_base(args[0]))), start);
+    return new_node_cast(new_node_binary(ND_ASSIGN, lhs, new_node_num(0, start), start), ty_void);
+  }
+
+  if (equal(tok, "__atomic_compare_exchange_n")) {
+    builtin_args(rest, tok->next, args, 6);
+    return new_cas(args[0], args[1], new_node_cast(args[2], atomic_base(args[0])), start);
+  }
+
+  // __sync_bool_compare_and_swap(p, old, new) -> (tmp = old, CAS(p, &tmp, new))
+  // __sync_val_compare_and_swap(p, old, new)  -> (tmp = old, CAS(p, &tmp, new), tmp)
+  if (equal(tok, "__sync_bool_compare_and_swap") || equal(tok, "__sync_val_compare_and_swap")) {
+    builtin_args(rest, tok->next, args, 3);
+    Type *ty = atomic_base(args[0]);
+    Var *var = new_lvar("", ty);
+    Node *node = new_node_binary(ND_ASSIGN, new_node_var(var, start), args[1], start);
+    node = new_node_binary(ND_COMMA, node,
+                           new_cas(args[0], new_node_unary(ND_ADDR, new_node_var(var, start), start),
+                                   new_node_cast(args[2], ty), start),
+                           start);
+    if (equal(tok, "__sync_val_compare_and_swap"))
+      node = new_node_binary(ND_COMMA, node, new_node_var(var, start), start);
+    return node;
+  }
+
+  if (equal(tok, "__atomic_thread_fence")) {
+    builtin_args(rest, tok->next, args, 1);
+    if (is_seq_cst(args[0]))
+      return new_node(ND_FENCE, start);
+    return new_node_cast(new_node_num(0, start), ty_void);
+  }
+
+  if (equal(tok, "__atomic_signal_fence")) {
+    builtin_args(rest, tok->next, args, 1);
+    return new_node_cast(new_node_num(0, start), ty_void);
+  }
+
+  if (equal(tok, "__sync_synchronize")) {
+    builtin_args(rest, tok->next, args, 0);
+    return new_node(ND_FENCE, start);
+  }
+
+  return NULL;
+}
+
+// whether eval() can compute a node at compile time
+static bool is_const_expr(Node *node) {
+  generate_type(node);
+
+  switch (node->kind) {
+  case ND_ADD:
+  case ND_SUB:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_MOD:
+  case ND_BITAND:
+  case ND_BITOR:
+  case ND_BITXOR:
+  case ND_LOGAND:
+  case ND_LOGOR:
+  case ND_SHL:
+  case ND_SHR:
+  case ND_EQ:
+  case ND_NE:
+  case ND_LT:
+  case ND_LE:
+    return is_const_expr(node->lhs) && is_const_expr(node->rhs);
+  case ND_NOT:
+  case ND_BITNOT:
+  case ND_CAST:
+    return is_const_expr(node->lhs);
+  case ND_COND:
+    return is_const_expr(node->cond) && is_const_expr(node->then) && is_const_expr(node->els);
+  case ND_COMMA:
+    return is_const_expr(node->rhs);
+  case ND_NUM:
+    return true;
+  }
+  return false;
+}
+
+static Node *new_builtin(BuiltinKind kind, Type *ty, Token *tok) {
+  Node *node = new_node(ND_BUILTIN, tok);
+  node->builtin = kind;
+  node->ty = ty;
+  return node;
+}
+
+static Node *new_alloca(Node *sz) {
+  Node *node = new_builtin(BI_ALLOCA, pointer_to(ty_void), sz->token);
+  node->lhs = new_node_cast(sz, ty_ulong);
+  get_alloca_bottom();
+  return node;
+}
+
+// builtins that take one integer operand (of the given type)
+static struct {
+  char *name;
+  BuiltinKind kind;
+  Type **ty;
+} unary_builtins[] = {
+  {"__builtin_popcount", BI_POPCOUNT, &ty_uint},
+  {"__builtin_popcountl", BI_POPCOUNT, &ty_ulong},
+  {"__builtin_popcountll", BI_POPCOUNT, &ty_ulong},
+  {"__builtin_clz", BI_CLZ, &ty_uint},
+  {"__builtin_clzl", BI_CLZ, &ty_ulong},
+  {"__builtin_clzll", BI_CLZ, &ty_ulong},
+  {"__builtin_ctz", BI_CTZ, &ty_uint},
+  {"__builtin_ctzl", BI_CTZ, &ty_ulong},
+  {"__builtin_ctzll", BI_CTZ, &ty_ulong},
+  {"__builtin_bswap16", BI_BSWAP, &ty_ushort},
+  {"__builtin_bswap32", BI_BSWAP, &ty_uint},
+  {"__builtin_bswap64", BI_BSWAP, &ty_ulong},
+};
+
+// the builtin function registry. returns NULL if `tok` is not a builtin.
+// builtins are not functions: each one is lowered to inline code by
+// gen_builtin() (or to other nodes, for the atomics)
+static Node *builtin(Token **rest, Token *tok) {
+  Token *start = tok;
+  Node *args[3];
+
+  for (int i = 0; i < sizeof(unary_builtins) / sizeof(*unary_builtins); i++) {
+    if (!equal(tok, unary_builtins[i].name))
+      continue;
+
+    builtin_args(rest, tok->next, args, 1);
+    Type *ty = *unary_builtins[i].ty;
+    Node *node = new_builtin(unary_builtins[i].kind, (unary_builtins[i].kind == BI_BSWAP) ? ty : ty_int, start);
+    node->lhs = new_node_cast(args[0], ty);
+    return node;
+  }
+
+  // the second argument (the last named parameter) is optional and unused
+  if (equal(tok, "__builtin_va_start")) {
+    tok = skip_id(tok->next, '(');
+    Node *node = new_builtin(BI_VA_START, ty_void, start);
+    node->lhs = assign(&tok, tok);
+    generate_type(node->lhs);
+    if (consume_id(&tok, tok, ','))
+      assign(&tok, tok);
+    *rest = skip_id(tok, ')');
+    return node;
+  }
+
+  // __builtin_expect(expr, expected) evaluates to `expr`.
+  // a constant expected value is kept as a hint for the code layout
+  if (equal(tok, "__builtin_expect")) {
+    builtin_args(rest, tok->next, args, 2);
+    if (!is_const_expr(args[1]))
+      return new_node_binary(ND_COMMA, args[1], new_node_cast(args[0], ty_long), start);
+    Node *node = new_builtin(BI_EXPECT, ty_long, start);
+    node->lhs = new_node_cast(args[0], ty_long);
+    node->val = eval(args[1]);
+    return node;
+  }
+
+  // __builtin_prefetch(addr [, rw [, locality]])
+  if (equal(tok, "__builtin_prefetch")) {
+    tok = skip_id(tok->next, '(');
+    Node *node = new_builtin(BI_PREFETCH, ty_void, start);
+    node->lhs = assign(&tok, tok);
+    generate_type(node->lhs);
+    node->val = 3;
+    if (consume_id(&tok, tok, ',')) {
+      const_expr(&tok, tok); // prefetching for write needs PRFCHW; not used
+      if (consume_id(&tok, tok, ','))
+        node->val = const_expr(&tok, tok);
+    }
+    *rest = skip_id(tok, ')');
+    return node;
+  }
+
+  // the area lives until the function returns, or until a VLA declared
+  // before it goes out of scope (which is what GCC does as well)
+  if (equal(tok, "__builtin_alloca")) {
+    builtin_args(rest, tok->next, args, 1);
+    return new_alloca(args[0]);
+  }
+
+  if (equal(tok, "__builtin_unreachable")) {
+    builtin_args(rest, tok->next, args, 0);
+    return new_builtin(BI_UNREACHABLE, ty_void, start);
+  }
+
+  if (equal(tok, "__builtin_memcpy") || equal(tok, "__builtin_memset")) {
+    builtin_args(rest, tok->next, args, 3);
+    bool is_memcpy = equal(tok, "__builtin_memcpy");
+
+    Node *node = new_builtin(is_memcpy ? BI_MEMCPY : BI_MEMSET, pointer_to(ty_void), start);
+    node->lhs = args[0];
+    node->rhs = is_memcpy ? args[1] : new_node_cast(args[1], ty_int);
+    if (is_const_expr(args[2]))
+      node->val = eval(args[2]);
+    else
+      node->size = new_node_cast(args[2], ty_ulong);
+    return node;
+  }
+
+  if (equal(tok, "__builtin_constant_p")) {
+    builtin_args(rest, tok->next, args, 1);
+    return new_node_num(is_const_expr(args[0]), start);
+  }
+
+  return atomic_builtin(rest, tok);
+}
+
 // primary = "(" "{" stmt stmt* "}" ")"
 //           | "(" expr ")"
 //           | "sizeof" "(" typename ")"
@@ -2188,11 +3368,11 @@ static Node *postfix(Token **rest, Token *tok) {
 static Node *primary(Token **rest, Token *tok) {
   Token *start = tok;
 
-  if (consume(&tok, tok, "(")) {
-    if (equal(tok, "{")) {
+  if (consume_id(&tok, tok, '(')) {
+    if (tok->id == '{') {
       Node *node = new_node(ND_STMT_EXPR, start);
       node->body = block_stmt(&tok, tok)->body;
-      tok =  skip(tok, ")");
+      tok =  skip_id(tok, ')');
 
       Node *cur = node->body;
       while(cur && cur->next)
@@ -2205,12 +3385,18 @@ static Node *primary(Token **rest, Token *tok) {
     }
 
     Node *node = expr(&tok, tok);
-    tok =  skip(tok, ")");
+    tok =  skip_id(tok, ')');
     *rest = tok;
     return node;
   }
 
   if (tok->kind == TK_IDENT) {
+    if (tok->next->id == '(') {
+      Node *node = builtin(rest, tok);
+      if (node)
+        return node;
+    }
+
     // variable or enum constant
     Token *start = tok;
     char *name = expect_ident(rest, tok);
@@ -2224,7 +3410,7 @@ static Node *primary(Token **rest, Token *tok) {
         return new_node_num(sc->enum_val, start);
     }
 
-    if (equal(tok->next, "(")) {
+    if (tok->next->id == '(') {
       warn_tok(start, "implicit declaration of a function");
       Var *var = new_gvar(name, func_returning(ty_int), true, false);
       return new_node_var(var, start);
@@ -2233,43 +3419,58 @@ static Node *primary(Token **rest, Token *tok) {
     error_tok(start, "undefined variable");
   }
 
-  if (consume(&tok, tok, "sizeof")) {
-    if (equal(tok, "(") && is_typename(tok->next)) {
+  if (consume_id(&tok, tok, KW_SIZEOF)) {
+    if (tok->id == '(' && is_typename(tok->next)) {
       Type *ty = typename(&tok, tok->next);
-      *rest = skip(tok, ")");
+      *rest = skip_id(tok, ')');
+      if (ty->kind == TY_VLA) {
+        Node *size = compute_vla_size(ty, start);
+        return new_node_binary(ND_COMMA, size, new_node_var(ty->vla_size, start), start);
+      }
       return new_node_num_ulong(size_of(ty), tok);
     }
 
     Node *node = unary(&tok, tok);
     generate_type(node);
     *rest = tok;
+    // the size of a variable-length array is evaluated at runtime
+    if (node->ty->kind == TY_VLA)
+      return new_node_var(node->ty->vla_size, start);
     return new_node_num_ulong(size_of(node->ty), start);
   }
 
-  if (consume(&tok, tok, "alignof")) {
-    tok = skip(tok, "(");
+  if (consume_id(&tok, tok, KW_ALIGNOF)) {
+    tok = skip_id(tok, '(');
     Type *ty = typename(&tok, tok);
-    *rest = skip(tok, ")");
+    *rest = skip_id(tok, ')');
     return new_node_num_ulong(ty->align, tok);
   }
 
   if (tok->kind == TK_STR) {
-    Var *var = new_string_literal(tok->contents, tok->cont_len);
+    Literal *lit = token_lit(tok);
+    Var *var = new_string_literal(lit->contents, lit->cont_len);
     expect_string(&tok, tok);
     *rest = tok;
     return new_node_var(var, start);
   }
 
+  // #embed outside a global array initializer
+  if (tok->kind == TK_EMBED) {
+    expand_embed(tok);
+    return primary(rest, tok);
+  }
+
   if (tok->kind != TK_NUM)
     error_tok(start, "unexpected expression");
 
+  Literal *lit = token_lit(tok);
   Node *node;
-  if (is_flonum(tok->ty))
-    node = new_node_fnum(tok->fval, 1, start);
+  if (is_flonum(lit->ty))
+    node = new_node_fnum(lit->fval, 1, start);
   else
-    node = new_node_num(tok->val, start);
+    node = new_node_num(lit->val, start);
 
-  node->ty = tok->ty;
+  node->ty = lit->ty;
   *rest = tok->next;
   return node;
 }
@@ -2293,11 +3494,11 @@ static Node *funcall(Token **rest, Token *tok, Node *fn) {
   Type *ty = (fn->ty->kind == TY_FUNC) ? fn->ty : fn->ty->base;
   Type *param_ty = ty->params;
 
-  tok = skip(tok, "(");
+  tok = skip_id(tok, '(');
 
-  while (!equal(tok, ")")) {
+  while (tok->id != ')') {
     if (nargs)
-      tok =  skip(tok, ",");
+      tok =  skip_id(tok, ',');
 
     Token *var_tok = tok;
     Node *arg = assign(&tok, tok);
@@ -2309,9 +3510,12 @@ static Node *funcall(Token **rest, Token *tok, Node *fn) {
     } else if (arg->ty->kind == TY_FLOAT) {
       // when the typename is unspecfied, float type argumnt must be promoted to double
       arg = new_node_cast(arg, ty_double);
+    } else if (is_integer(arg->ty) && size_of(arg->ty) < 4) {
+      // ...and _Bool, char and short to int
+      arg = new_node_cast(arg, ty_int);
     }
 
-    Var *var = arg->ty->base
+    Var *var = is_pointer_like(arg->ty)
              ? new_lvar("", pointer_to(arg->ty->base))
              : new_lvar("", arg->ty);
 
@@ -2322,13 +3526,16 @@ static Node *funcall(Token **rest, Token *tok, Node *fn) {
     Node *expr = new_node_binary(ND_ASSIGN, new_node_var(var, tok), arg, var_tok);
     node = new_node_binary(ND_COMMA, node, expr, tok);
   }
-  *rest = skip(tok, ")");
+  *rest = skip_id(tok, ')');
 
   Node *funcall = new_node_unary(ND_FUNCALL, fn, start);
   funcall->func_ty = ty;
   funcall->ty = ty->return_ty;
   funcall->args = args;
   funcall->nargs = nargs;
+  // a buffer for the returned struct
+  if (funcall->ty->kind == TY_STRUCT)
+    funcall->var = new_lvar("", funcall->ty);
 
   return new_node_binary(ND_COMMA, node, funcall, start);
 }
@@ -9,22 +9,38 @@ struct MacroParam {
   char *name;
 };
 
+// a token read during macro expansion, with the hideset it has there
+typedef struct {
+  Token *tok;
+  Hideset *hs;
+  bool in_place; // read from the input list, so it can be emitted without a copy
+} TokenRef;
+
+typedef struct {
+  TokenRef *data;
+  int len;
+  int capacity;
+} TokenRefs;
+
 typedef struct MacroArg MacroArg;
 struct MacroArg {
   MacroArg *next;
   char *name;
-  Token *tok;
+  TokenRefs raw;       // the argument as written
+  TokenRefs *expanded; // the argument fully macro-expanded, made on first use
+  Token *tok;          // a copy of `raw`, for bodies that use # or ##
 };
 
 typedef struct Macro Macro;
 struct Macro {
-  Macro *next;
   char *name;
   bool is_objlike; // shows wheather it is objlike-like or function-like
   MacroParam *params;
   bool is_variadic;
   Token *body;
+  bool has_hash_ops; // its body uses # or ##
   bool deleted;
+  bool predefined; // system headers may define these again, e.g. __STDC_ISO_10646__
 };
 
 // `#if` can be nested, so we use a stack to manage nested `#if`s
@@ -42,7 +58,13 @@ struct Hideset {
   char *name;
 };
 
-static Macro *macros;
+// macros are kept in an open-addressed hash table keyed by their interned
+// names, at most half full. a redefinition replaces the macro in its slot,
+// and #undef marks it deleted
+static Macro **macro_table;
+static int macro_capacity;
+static int macro_count;
+
 static Macro *file_macro;
 static Macro *line_macro;
 static CondIncl *cond_incl;
@@ -51,7 +73,7 @@ static Token *preprocess2(Token *tok);
 static Macro *find_macro(Token *tok);
 
 static bool is_hash(Token *tok) {
-  return tok->at_bol && equal(tok, "#");
+  return tok->at_bol && tok->id == '#';
 }
 
 // skip extraneous tokens
@@ -69,7 +91,7 @@ static Token *skip_line(Token *tok) {
 }
 
 static Token *copy_token(Token *tok) {
-  Token *t = malloc(sizeof(Token));
+  Token *t = alloc_token();
   *t = *tok;
   t->next = NULL;
   return t;
@@ -78,12 +100,13 @@ static Token *copy_token(Token *tok) {
 static Token *new_eof(Token *tok) {
   Token *t = copy_token(tok);
   t->kind = TK_EOF;
+  t->id = ID_NONE;
   t->len = 0;
   return t;
 }
 
 // double quote given string and returns it
-static char *quote_string(char *str)  {
+char *quote_string(char *str)  {
   int bufsize = 3; // at minimum we need an array of three bytes that can contain: ""\0
 
   for (int i = 0; str[i]; i++) {
@@ -107,13 +130,15 @@ static char *quote_string(char *str)  {
 
 static Token *new_str_token(char *str, Token *tmpl) {
   char *buf = quote_string(str);
-  return tokenize(tmpl->filename, tmpl->file_no, buf);
+  File *file = token_file(tmpl);
+  return tokenize(file->name, file->file_no, buf);
 }
 
 static Token *new_num_token(int val, Token *tmpl) {
   char *buf = malloc(20);
   sprintf(buf, "%d\n", val);
-  return tokenize(tmpl->filename, tmpl->file_no, buf);
+  File *file = token_file(tmpl);
+  return tokenize(file->name, file->file_no, buf);
 }
 
 // concatenates two tokens to create a new token
@@ -122,7 +147,8 @@ static Token *paste(Token *lhs, Token *rhs) {
   sprintf(buf, "%.*s%.*s", lhs->len, lhs->str, rhs->len, rhs->str);
 
   // tokenize the concatenated string
-  Token *tok = tokenize(lhs->filename, lhs->file_no, buf);
+  File *file = token_file(lhs);
+  Token *tok = tokenize(file->name, file->file_no, buf);
   if (tok->next->kind != TK_EOF)
     error_tok(lhs, "pasting forms `%s`, an invalid token", buf);
   return tok;
@@ -193,92 +219,269 @@ static Token *copy_line(Token **rest, Token *tok) {
   return head.next;
 }
 
-static Hideset *new_hideset(char *name) {
-  Hideset *hs = calloc(1, sizeof(Hideset));
+// hidesets are hash-consed: a set is a list of names sorted by address,
+// and no two nodes have the same name and rest, so equal sets are the same
+// pointer. that lets tokens share hidesets, and lets union and
+// intersection be memoized on pairs of pointers.
+typedef struct {
+  void *key1;
+  void *key2;
+  Hideset *val;
+} HidesetEntry;
+
+typedef struct {
+  HidesetEntry *entries;
+  int capacity;
+  int used;
+} HidesetTable;
+
+static HidesetTable hideset_nodes;  // (name, next) -> node
+static HidesetTable hideset_unions; // (hs1, hs2) -> union
+static HidesetTable hideset_inters; // (hs1, hs2) -> intersection
+
+static unsigned hash_pair(void *k1, void *k2) {
+  unsigned long x = (unsigned long)k1 * 31 + (unsigned long)k2;
+  return (x >> 4) * 2654435761u;
+}
+
+// returns the value for (k1, k2), or NULL with *found unset
+static Hideset *hideset_find(HidesetTable *t, void *k1, void *k2, bool *found) {
+  *found = false;
+  if (!t->capacity)
+    return NULL;
+
+  unsigned i = hash_pair(k1, k2) & (t->capacity - 1);
+  for (; t->entries[i].key1; i = (i + 1) & (t->capacity - 1)) {
+    HidesetEntry *e = &t->entries[i];
+    if (e->key1 == k1 && e->key2 == k2) {
+      *found = true;
+      return e->val;
+    }
+  }
+  return NULL;
+}
+
+static void hideset_insert(HidesetTable *t, void *k1, void *k2, Hideset *val);
+
+static void grow_hideset_table(HidesetTable *t) {
+  HidesetEntry *old = t->entries;
+  int old_capacity = t->capacity;
+
+  t->capacity = t->capacity ? t->capacity * 2 : 256;
+  t->entries = calloc(t->capacity, sizeof(HidesetEntry));
+  t->used = 0;
+  for (int i = 0; i < old_capacity; i++)
+    if (old[i].key1)
+      hideset_insert(t, old[i].key1, old[i].key2, old[i].val);
+  free(old);
+}
+
+// `k1` must not be NULL, which marks an empty entry
+static void hideset_insert(HidesetTable *t, void *k1, void *k2, Hideset *val) {
+  if (t->used * 2 >= t->capacity)
+    grow_hideset_table(t);
+
+  unsigned i = hash_pair(k1, k2) & (t->capacity - 1);
+  while (t->entries[i].key1)
+    i = (i + 1) & (t->capacity - 1);
+
+  HidesetEntry *e = &t->entries[i];
+  e->key1 = k1;
+  e->key2 = k2;
+  e->val = val;
+  t->used++;
+}
+
+// returns the unique node for `name` followed by `next`
+static Hideset *hideset_cons(char *name, Hideset *next) {
+  bool found;
+  Hideset *hs = hideset_find(&hideset_nodes, name, next, &found);
+  if (found)
+    return hs;
+
+  hs = calloc(1, sizeof(Hideset));
   hs->name = name;
+  hs->next = next;
+  hideset_insert(&hideset_nodes, name, next, hs);
   return hs;
 }
 
-static bool hideset_contains(Hideset *hs, char *s, int len) {
-  for (; hs; hs = hs->next)
-    if (strlen(hs->name) == len && !strncmp(hs->name, s, len))
+static bool name_before(char *a, char *b) {
+  return (unsigned long)a < (unsigned long)b;
+}
+
+static Hideset *new_hideset(char *name) {
+  return hideset_cons(name, NULL);
+}
+
+// `name` is an interned identifier
+static bool hideset_contains(Hideset *hs, char *name) {
+  for (; hs && !name_before(name, hs->name); hs = hs->next)
+    if (hs->name == name)
       return true;
   return false;
 }
 
 static Hideset *hideset_union(Hideset *hs1, Hideset *hs2) {
-  Hideset head = {};
-  Hideset *cur = &head;
+  if (!hs1 || hs1 == hs2)
+    return hs2;
+  if (!hs2)
+    return hs1;
+
+  // union is commutative, so memoize it under one order of the operands
+  if (name_before((char *)hs2, (char *)hs1)) {
+    Hideset *tmp = hs1;
+    hs1 = hs2;
+    hs2 = tmp;
+  }
 
-  for (; hs1; hs1 = hs1->next)
-    cur = cur->next = new_hideset(hs1->name);
+  bool found;
+  Hideset *hs = hideset_find(&hideset_unions, hs1, hs2, &found);
+  if (found)
+    return hs;
 
-  cur->next = hs2;
-  return head.next;
+  if (hs1->name == hs2->name)
+    hs = hideset_cons(hs1->name, hideset_union(hs1->next, hs2->next));
+  else if (name_before(hs1->name, hs2->name))
+    hs = hideset_cons(hs1->name, hideset_union(hs1->next, hs2));
+  else
+    hs = hideset_cons(hs2->name, hideset_union(hs1, hs2->next));
+
+  hideset_insert(&hideset_unions, hs1, hs2, hs);
+  return hs;
 }
 
 static Hideset *hideset_intersection(Hideset *hs1, Hideset *hs2) {
-  Hideset head = {};
-  Hideset *cur = &head;
+  if (!hs1 || !hs2)
+    return NULL;
+  if (hs1 == hs2)
+    return hs1;
 
-  for (; hs1; hs1 = hs1->next)
-    if (hideset_contains(hs2, hs1->name, strlen(hs1->name)))
-      cur = cur->next = new_hideset(hs1->name);
+  if (name_before((char *)hs2, (char *)hs1)) {
+    Hideset *tmp = hs1;
+    hs1 = hs2;
+    hs2 = tmp;
+  }
 
-  return head.next;
+  bool found;
+  Hideset *hs = hideset_find(&hideset_inters, hs1, hs2, &found);
+  if (found)
+    return hs;
+
+  if (hs1->name == hs2->name)
+    hs = hideset_cons(hs1->name, hideset_intersection(hs1->next, hs2->next));
+  else if (name_before(hs1->name, hs2->name))
+    hs = hideset_intersection(hs1->next, hs2);
+  else
+    hs = hideset_intersection(hs1, hs2->next);
+
+  hideset_insert(&hideset_inters, hs1, hs2, hs);
+  return hs;
 }
 
-static Token *add_hideset(Token *tok, Hideset *hs) {
-  Token head = {};
-  Token *cur = &head;
+static unsigned hash_atom(char *name) {
+  return ((unsigned long)name >> 4) * 2654435761u;
+}
 
-  for (; tok; tok = tok->next) {
-    Token *t = copy_token(tok);
-    t->hideset = hideset_union(t->hideset, hs);
-    cur = cur->next = t;
-  }
-  return head.next;
+static Macro **macro_slot(char *name) {
+  unsigned i = hash_atom(name) & (macro_capacity - 1);
+  while (macro_table[i] && macro_table[i]->name != name)
+    i = (i + 1) & (macro_capacity - 1);
+  return &macro_table[i];
+}
+
+static void grow_macro_table(void) {
+  Macro **old = macro_table;
+  int old_capacity = macro_capacity;
+
+  macro_capacity = macro_capacity ? macro_capacity * 2 : 1024;
+  macro_table = calloc(macro_capacity, sizeof(Macro *));
+  for (int i = 0; i < old_capacity; i++)
+    if (old[i])
+      *macro_slot(old[i]->name) = old[i];
+  free(old);
 }
 
 static Macro *find_macro(Token *tok) {
-  if (tok->kind != TK_IDENT)
+  if (tok->kind != TK_IDENT || !macro_table)
     return NULL;
 
-  for (Macro *m = macros; m; m = m->next)
-    if (strlen(m->name) == tok->len && !strncmp(m->name, tok->str, tok->len))
-      return m->deleted ? NULL : m;
-  return NULL;
+  Macro *m = *macro_slot(tok->name);
+  return (m && !m->deleted) ? m : NULL;
 }
 
 static Macro *add_macro(char *name, bool is_objlike, Token *body) {
+  if (macro_count * 2 >= macro_capacity)
+    grow_macro_table();
+
+  Macro **slot = macro_slot(name);
+  if (!*slot)
+    macro_count++;
+
   Macro *m = calloc(1, sizeof(Macro));
-  m->next = macros;
   m->name = name;
   m->is_objlike = is_objlike;
   m->body = body;
-  macros = m;
+  *slot = m;
   return m;
 }
 
+static void undef_macro(char *name) {
+  if (!macro_table)
+    return;
+  Macro *m = *macro_slot(name);
+  if (m)
+    m->deleted = true;
+}
+
+// two definitions of a macro are the same if they have the same kind,
+// parameters and body, where bodies are compared by spelling and by
+// whether their tokens are separated by whitespace
+static bool same_definition(Macro *m1, Macro *m2) {
+  if (m1->is_objlike != m2->is_objlike || m1->is_variadic != m2->is_variadic)
+    return false;
+
+  MacroParam *p1 = m1->params;
+  MacroParam *p2 = m2->params;
+  for (; p1 && p2; p1 = p1->next, p2 = p2->next)
+    if (p1->name != p2->name)
+      return false;
+  if (p1 || p2)
+    return false;
+
+  Token *t1 = m1->body;
+  Token *t2 = m2->body;
+  if (!t1 || !t2)
+    return t1 == t2;
+
+  for (; t1->kind != TK_EOF && t2->kind != TK_EOF; t1 = t1->next, t2 = t2->next) {
+    if (t1->len != t2->len || strncmp(t1->str, t2->str, t1->len))
+      return false;
+    if (t1 != m1->body && t1->has_space != t2->has_space)
+      return false;
+  }
+  return t1->kind == TK_EOF && t2->kind == TK_EOF;
+}
+
 static MacroParam *read_macro_params(Token **rest, Token *tok, bool *is_variadic) {
   MacroParam head = {};
   MacroParam *cur  = &head;
 
-  while(!equal(tok, ")")){
+  while(tok->id != ')'){
     if (cur != &head)
-      tok = skip(tok, ",");
+      tok = skip_id(tok, ',');
 
-    if (equal(tok, "...")) {
+    if (tok->id == OP_ELLIPSIS) {
       *is_variadic = true;
       tok = tok->next;
-      skip(tok, ")");
+      skip_id(tok, ')');
       break;
     }
 
     if (tok->kind != TK_IDENT)
       error_tok(tok, "expected an identifier");
     MacroParam *m = calloc(1, sizeof(MacroParam));
-    m->name = strndup(tok->str, tok->len);
+    m->name = tok->name;
     cur = cur->next = m;
     tok = tok->next;
   }
@@ -290,94 +493,91 @@ static MacroParam *read_macro_params(Token **rest, Token *tok, bool *is_variadic
 static void read_macro_definition(Token **rest, Token *tok) {
   if (tok->kind != TK_IDENT)
     error_tok(tok, "macro name must be an identifier");
-  char *name = strndup(tok->str, tok->len);
+  Token *name_tok = tok;
+  char *name = tok->name;
+  Macro *old = find_macro(tok);
   tok = tok->next;
 
-  if (!tok->has_space && equal(tok, "(")) {
+  Macro *m;
+  if (!tok->has_space && tok->id == '(') {
     // function-like macro
     bool is_variadic = false;
     MacroParam *params = read_macro_params(&tok, tok->next, &is_variadic);
 
-    Macro *m = add_macro(name, false, copy_line(rest,tok));
+    m = add_macro(name, false, copy_line(rest,tok));
     m->params = params;
     m->is_variadic = is_variadic;
+    for (Token *t = m->body; t->kind != TK_EOF; t = t->next)
+      if (t->id == '#' || t->id == OP_PASTE)
+        m->has_hash_ops = true;
   } else {
     // object-like macro
-    add_macro(name, true, copy_line(rest,tok));
+    m = add_macro(name, true, copy_line(rest,tok));
   }
-}
-
-static MacroArg *read_macro_arg_one(Token **rest, Token *tok, bool read_rest) {
-  Token head = {};
-  Token *cur  = &head;
-  int level = 0;
 
-  for (;;) {
-    if (level == 0 && equal(tok, ")"))
-      break;
-    if (level == 0 && !read_rest && equal(tok, ","))
-      break;
-
-    if (tok->kind == TK_EOF)
-      error_tok(tok, "premature end of input");
-
-    if (equal(tok, "("))
-      level++;
-    else if (equal(tok, ")"))
-      level--;
-
-    cur = cur->next = copy_token(tok);
-    tok = tok->next;
-  }
-  MacroArg *arg = calloc(1, sizeof(MacroArg));
-  arg->tok = head.next;
-  *rest = tok;
-  return arg;
+  if (old && !old->predefined && !same_definition(old, m))
+    warn_tok(name_tok, "'%s' redefined", name);
 }
 
-static MacroArg *
-read_macro_args(Token **rest, Token *tok, MacroParam *params, bool is_variadic) {
-  Token *start = tok;
-  tok = tok->next->next;
+// macro expansion reads tokens through a stack of contexts, which point
+// into macro bodies and arguments in place. a token is copied only when
+// it is emitted, with the hideset it has picked up on the way.
+typedef struct Context Context;
+struct Context {
+  Context *prev;
+  Hideset *hs;     // added to the hideset of every token read from here
+  Token *tok;      // the next token of a token list, such as a macro body,
+  MacroArg *args;  // ...and the arguments its parameters refer to
+  TokenRefs *refs; // or the tokens of an argument
+  int pos;
+};
 
-  MacroArg head = {};
-  MacroArg *cur  = &head;
+typedef struct {
+  Context *top;
+  Token **base; // the input list, or NULL while expanding an argument alone
+} Reader;
 
-  MacroParam *pp = params;
-  for (; pp; pp = pp->next) {
-    if (cur != &head) {
-      if (!equal(tok, ","))
-        error_tok(tok, "too few arguments ('%s' must be provided)", pp->name);
-      tok = tok->next;
-    }
-    cur = cur->next = read_macro_arg_one(&tok, tok, false);
-    cur->name = pp->name;
+static void push_ref(TokenRefs *v, TokenRef *t) {
+  if (v->len == v->capacity) {
+    v->capacity = v->capacity ? v->capacity * 2 : 8;
+    v->data = realloc(v->data, sizeof(TokenRef) * v->capacity);
   }
+  v->data[v->len++] = *t;
+}
 
-  if (is_variadic) {
-    if (pp != params)
-      tok = skip(tok, ",");
-    cur = cur->next = read_macro_arg_one(&tok, tok, true);
-    cur->name = "__VA_ARGS__";
-  } else if (!equal(tok, ")")) {
-    error_tok(tok, "too many arguments");
-  }
+static void push_context(Reader *r, Token *tok, TokenRefs *refs, MacroArg *args, Hideset *hs) {
+  Context *c = calloc(1, sizeof(Context));
+  c->prev = r->top;
+  c->hs = hs;
+  c->tok = tok;
+  c->args = args;
+  c->refs = refs;
+  r->top = c;
+}
 
-  *rest = skip(tok, ")");
-  return head.next;
+static bool context_done(Context *c) {
+  if (c->refs)
+    return c->pos == c->refs->len;
+  return !c->tok || c->tok->kind == TK_EOF;
 }
 
 // macro arguments can be empty
 static Token *EMPTY = (Token *)-1;
 
-static Token *find_arg(MacroArg *args, Token *tok) {
-  for (MacroArg *ap = args; ap; ap = ap->next) {
-    if (tok->len == strlen(ap->name) && !strncmp(tok->str, ap->name, tok->len))
-      return ap->tok ? ap->tok : EMPTY;
-  }
+static MacroArg *find_macro_arg(MacroArg *args, Token *tok) {
+  for (MacroArg *ap = args; ap; ap = ap->next)
+    if (ap->name == tok->name)
+      return ap;
   return NULL;
 }
 
+static Token *find_arg(MacroArg *args, Token *tok) {
+  MacroArg *ap = find_macro_arg(args, tok);
+  if (!ap)
+    return NULL;
+  return ap->tok ? ap->tok : EMPTY;
+}
+
 // replace func-like macro parameters with given arguments
 static Token *subst(Token *tok, MacroArg *args) {
   Token head = {};
@@ -391,7 +591,7 @@ static Token *subst(Token *tok, MacroArg *args) {
       tok = tok->next;
 
       // x##y becomes y if x is an empty argument list
-      if (arg == EMPTY && equal(tok, "##")) {
+      if (arg == EMPTY && tok->id == OP_PASTE) {
         tok = tok->next;
         continue;
       }
@@ -404,7 +604,7 @@ static Token *subst(Token *tok, MacroArg *args) {
 
     // replace x##y with xy. at this point LHS must have already been macro-expanded
     // and added to `cur`.
-    if (equal(tok, "##")) {
+    if (tok->id == OP_PASTE) {
       tok = tok->next;
       Token *rhs = find_arg(args, tok);
 
@@ -427,7 +627,7 @@ static Token *subst(Token *tok, MacroArg *args) {
     }
 
     // '#' followed by a parameter is replaced with stringized actuals
-    if (equal(tok, "#")) {
+    if (tok->id == '#') {
       Token *arg = find_arg(args, tok->next);
       if (arg) {
         cur =  cur->next = stringize(tok, arg);
@@ -445,9 +645,157 @@ static Token *subst(Token *tok, MacroArg *args) {
   return head.next;
 }
 
-static bool expand_macro(Token **rest, Token *tok) {
+static TokenRefs *expand_arg(MacroArg *arg);
+
+// pops finished contexts, and enters the argument that the next token of a
+// macro body refers to, so that the top context has a token ready
+static void prepare(Reader *r) {
+  while (r->top) {
+    Context *c = r->top;
+    if (context_done(c)) {
+      r->top = c->prev;
+      continue;
+    }
+
+    MacroArg *arg = c->args ? find_macro_arg(c->args, c->tok) : NULL;
+    if (!arg)
+      return;
+    c->tok = c->tok->next;
+    push_context(r, NULL, expand_arg(arg), NULL, c->hs);
+  }
+}
+
+// returns the next token without consuming it, or NULL at the end
+static Token *peek_token(Reader *r) {
+  prepare(r);
+  Context *c = r->top;
+  if (c)
+    return c->refs ? c->refs->data[c->pos].tok : c->tok;
+  if (r->base && (*r->base)->kind != TK_EOF)
+    return *r->base;
+  return NULL;
+}
+
+static bool read_token(Reader *r, TokenRef *t) {
+  prepare(r);
+  Context *c = r->top;
+
+  if (c && c->refs) {
+    TokenRef *ref = &c->refs->data[c->pos++];
+    t->tok = ref->tok;
+    t->hs = hideset_union(ref->hs, c->hs);
+    t->in_place = false;
+    return true;
+  }
+
+  if (c) {
+    t->tok = c->tok;
+    t->hs = hideset_union(c->tok->hideset, c->hs);
+    t->in_place = false;
+    c->tok = c->tok->next;
+    return true;
+  }
+
+  if (!r->base || (*r->base)->kind == TK_EOF)
+    return false;
+  t->tok = *r->base;
+  t->hs = t->tok->hideset;
+  t->in_place = true;
+  *r->base = t->tok->next;
+  return true;
+}
+
+// returns a token to put in the output list
+static Token *emit_token(TokenRef *t) {
+  if (t->in_place)
+    return t->tok;
+  Token *tok = copy_token(t->tok);
+  tok->hideset = t->hs;
+  return tok;
+}
+
+// consumes the next token, which must be `id`
+static void skip_token(Reader *r, Token *macro_tok, TokenId id, TokenRef *t) {
+  Token *tok = peek_token(r);
+  if (!tok)
+    error_tok(macro_tok, "premature end of input");
+  skip_id(tok, id);
+  read_token(r, t);
+}
+
+static MacroArg *read_macro_arg_one(Reader *r, Token *macro_tok, bool read_rest) {
+  MacroArg *arg = calloc(1, sizeof(MacroArg));
+  int level = 0;
+
+  for (;;) {
+    Token *tok = peek_token(r);
+    if (!tok)
+      error_tok(macro_tok, "premature end of input");
+
+    if (level == 0 && tok->id == ')')
+      break;
+    if (level == 0 && !read_rest && tok->id == ',')
+      break;
+
+    if (tok->id == '(')
+      level++;
+    else if (tok->id == ')')
+      level--;
+
+    TokenRef t;
+    read_token(r, &t);
+    t.in_place = false;
+    push_ref(&arg->raw, &t);
+  }
+  return arg;
+}
+
+// reads the arguments after the opening parenthesis, and the closing one
+static MacroArg *
+read_macro_args(Reader *r, Token *macro_tok, Macro *m, TokenRef *rparen) {
+  MacroArg head = {};
+  MacroArg *cur  = &head;
+  TokenRef comma;
+
+  MacroParam *pp = m->params;
+  for (; pp; pp = pp->next) {
+    if (cur != &head) {
+      Token *tok = peek_token(r);
+      if (tok->id != ',')
+        error_tok(tok, "too few arguments ('%s' must be provided)", pp->name);
+      read_token(r, &comma);
+    }
+    cur = cur->next = read_macro_arg_one(r, macro_tok, false);
+    cur->name = pp->name;
+  }
+
+  if (m->is_variadic) {
+    if (pp != m->params)
+      skip_token(r, macro_tok, ',', &comma);
+    cur = cur->next = read_macro_arg_one(r, macro_tok, true);
+    cur->name = intern("__VA_ARGS__", 11);
+  } else if (peek_token(r)->id != ')') {
+    error_tok(peek_token(r), "too many arguments");
+  }
+
+  skip_token(r, macro_tok, ')', rparen);
+  return head.next;
+}
+
+// copies an argument into a token list, for subst()
+static Token *arg_tokens(MacroArg *arg) {
+  Token head = {};
+  Token *cur = &head;
+  for (int i = 0; i < arg->raw.len; i++)
+    cur = cur->next = emit_token(&arg->raw.data[i]);
+  return head.next;
+}
+
+static bool expand_macro(Reader *r, TokenRef *t) {
+  Token *tok = t->tok;
+
   // prohibit to expand a token more than once with the same macro
-  if (hideset_contains(tok->hideset, tok->str, tok->len))
+  if (hideset_contains(t->hs, tok->name))
     return false;
 
   Macro *m = find_macro(tok);
@@ -457,32 +805,30 @@ static bool expand_macro(Token **rest, Token *tok) {
   // for object-like macro application
   if (m->is_objlike) {
     if (m == file_macro) {
-      *rest = new_str_token(tok->filename, tok);
-      (*rest)->next = tok->next;
+      push_context(r, new_str_token(token_file(tok)->name, tok), NULL, NULL, NULL);
       return true;
     }
 
     if (m == line_macro) {
-      *rest = new_num_token(tok->line_no, tok);
-      (*rest)->next = tok->next;
+      push_context(r, new_num_token(tok->line_no, tok), NULL, NULL, NULL);
       return true;
     }
 
-    // append (copied chain of) macro body with expanded macro name,
-    // which is registered at the end of the tokens' hideset
-    Hideset *hs = hideset_union(tok->hideset, new_hideset(m->name));
-    Token *body = add_hideset(m->body, hs);
-    *rest = append(body, tok->next);
+    // read the macro body in place, with the expanded macro name
+    // registered in the tokens' hideset
+    Hideset *hs = hideset_union(t->hs, new_hideset(m->name));
+    push_context(r, m->body, NULL, NULL, hs);
     return true;
   }
 
   // function-like macro application
-  if (!equal(tok->next, "("))
+  Token *next = peek_token(r);
+  if (!next || next->id != '(')
     return false;
 
-  Token *macro_token = tok;
-  MacroArg *args  = read_macro_args(&tok, tok, m->params, m->is_variadic);
-  Token *rparen = tok;
+  TokenRef lparen, rparen;
+  read_token(r, &lparen);
+  MacroArg *args = read_macro_args(r, tok, m, &rparen);
 
   // tokens that consist a func-like macro invocation may have different
   // hidesets, and if that's the case, it's not clear what the hideset
@@ -490,15 +836,41 @@ static bool expand_macro(Token **rest, Token *tok) {
   // token and the closing parenthesis and use it as a new hideset, as
   // explained in the Dave Prossor's algorithm.
 
-  Hideset *hs = hideset_intersection(macro_token->hideset, rparen->hideset);
+  Hideset *hs = hideset_intersection(t->hs, rparen.hs);
   hs = hideset_union(hs, new_hideset(m->name));
 
-  Token *body = subst(m->body, args);
-  body = add_hideset(body, hs);
-  *rest = append(body, tok);
+  // # and ## work on the arguments as written, so such bodies are
+  // substituted up front. others are read in place, with each parameter
+  // replaced by its argument's expansion as the body is read
+  if (m->has_hash_ops) {
+    for (MacroArg *ap = args; ap; ap = ap->next)
+      ap->tok = arg_tokens(ap);
+    push_context(r, subst(m->body, args), NULL, NULL, hs);
+  } else {
+    push_context(r, m->body, NULL, args, hs);
+  }
   return true;
 }
 
+// fully macro-expands an argument on its own. the expansion is made once
+// per invocation, however many times the parameter occurs in the body
+static TokenRefs *expand_arg(MacroArg *arg) {
+  if (arg->expanded)
+    return arg->expanded;
+
+  Reader r = {};
+  push_context(&r, NULL, &arg->raw, NULL, NULL);
+
+  TokenRefs *out = calloc(1, sizeof(TokenRefs));
+  TokenRef t;
+  while (read_token(&r, &t))
+    if (!expand_macro(&r, &t))
+      push_ref(out, &t);
+
+  arg->expanded = out;
+  return out;
+}
+
 // skip all tokens from `#if`, `#ifdef`, `#ifndef`
 // upto the point where `#endif` comes up
 static Token *skip_cond_incl2(Token *tok) {
@@ -557,7 +929,7 @@ static Token *read_const_expr(Token **rest, Token *tok) {
     //   "0" otherwise
     if (equal(tok, "defined")) {
       Token *start = tok;
-      bool has_paren = consume(&tok, tok->next, "(");
+      bool has_paren = consume_id(&tok, tok->next, '(');
 
       if (tok->kind != TK_IDENT)
         error_tok(start, "macro name must be an identifier");
@@ -565,7 +937,7 @@ static Token *read_const_expr(Token **rest, Token *tok) {
       tok = tok->next;
 
       if (has_paren)
-        tok = skip(tok, ")");
+        tok = skip_id(tok, ')');
 
       cur = cur->next = new_num_token(m ? 1 : 0, start);
       continue;
@@ -637,25 +1009,25 @@ static char *read_include_path(Token **rest, Token *tok) {
     // So we don't want to use token->contents here
     Token *start = tok;
     char *filename = strndup(tok->str + 1, tok->len - 2); // double-quote in both ends "..." are excluded
-    *rest = skip_line(tok->next);
+    *rest = tok->next;
     if (file_exists(filename))
       return filename;
     return search_include_paths(filename, start);
   }
 
   // pattern B: #include <foo.h>
-  if (equal(tok, "<")) {
+  if (tok->id == '<') {
     // reconstruct a filename from a sequence of tokens between
     // "<" and ">"
     Token *start = tok;
 
     // find closing ">"
-    for (; !equal(tok, ">"); tok = tok->next)
+    for (; tok->id != '>'; tok = tok->next)
       if (tok->kind == TK_EOF)
         error_tok(tok, "expected '>'");
 
     char *filename = join_tokens(start->next, tok);
-    *rest = skip_line(tok->next);
+    *rest = tok->next;
 
     return search_include_paths(filename, start);
   }
@@ -671,21 +1043,180 @@ static char *read_include_path(Token **rest, Token *tok) {
   error_tok(tok, "expected a filename");
 }
 
+// matches an #embed parameter name in either form: `limit` or `__limit__`
+static bool equal_embed_param(Token *tok, char *name) {
+  if (tok->kind != TK_IDENT)
+    return false;
+  if (equal(tok, name))
+    return true;
+
+  int len = strlen(name);
+  return tok->len == len + 4 && !strncmp(tok->str, "__", 2) &&
+         !strncmp(tok->str + 2, name, len) && !strncmp(tok->str + len + 2, "__", 2);
+}
+
+// reads a parenthesized #embed parameter argument and returns its tokens
+// (terminated by NULL, not by EOF)
+static Token *read_embed_param(Token **rest, Token *tok) {
+  tok = skip_id(tok, '(');
+
+  Token head = {};
+  Token *cur = &head;
+  int level = 0;
+
+  while (level > 0 || tok->id != ')') {
+    if (tok->at_bol)
+      error_tok(tok, "premature end of #embed parameter");
+
+    if (tok->id == '(')
+      level++;
+    else if (tok->id == ')')
+      level--;
+    cur = cur->next = copy_token(tok);
+    tok = tok->next;
+  }
+
+  *rest = tok->next;
+  return head.next;
+}
+
+// #embed "file" ( "limit" "(" const-expr ")"
+//               | "prefix" "(" tokens ")"
+//               | "suffix" "(" tokens ")"
+//               | "if_empty" "(" tokens ")" )*
+//
+// the resource is not read here. it is represented with a single TK_EMBED
+// token carrying its path and size, so that a global initializer can be
+// emitted with `.incbin` without tokenizing the bytes at all.
+static Token *read_embed(Token **rest, Token *tok) {
+  Token *start = tok;
+  char *path = read_include_path(&tok, tok->next);
+
+  long limit = -1;
+  Token *prefix = NULL;
+  Token *suffix = NULL;
+  Token *if_empty = NULL;
+
+  while (!tok->at_bol) {
+    if (equal_embed_param(tok, "limit")) {
+      Token *expr = read_embed_param(&tok, tok->next);
+      expr = preprocess2(append(expr, new_eof(tok)));
+
+      Token *rest2;
+      limit = const_expr(&rest2, expr);
+      if (rest2->kind != TK_EOF)
+        error_tok(rest2, "extra token");
+      if (limit < 0)
+        error_tok(start, "negative embed limit");
+      continue;
+    }
+
+    if (equal_embed_param(tok, "prefix")) {
+      prefix = read_embed_param(&tok, tok->next);
+      continue;
+    }
+
+    if (equal_embed_param(tok, "suffix")) {
+      suffix = read_embed_param(&tok, tok->next);
+      continue;
+    }
+
+    if (equal_embed_param(tok, "if_empty")) {
+      if_empty = read_embed_param(&tok, tok->next);
+      continue;
+    }
+
+    error_tok(tok, "unknown embed parameter");
+  }
+  *rest = tok;
+
+  struct stat st;
+  if (stat(path, &st))
+    error_tok(start, "%s: %s", path, strerror(errno));
+
+  long len = st.st_size;
+  if (limit >= 0 && limit < len)
+    len = limit;
+
+  if (len == 0)
+    return if_empty;
+
+  Token *t = copy_token(start);
+  t->kind = TK_EMBED;
+  t->at_bol = true;
+  t->has_space = false;
+  Literal *lit = new_literal(t);
+  lit->cont_len = len;
+  lit->embed_path = (path[0] == '/') ? path : join_paths(getcwd(NULL, 0), path);
+  t->next = suffix;
+  return append(prefix, t);
+}
+
+// returns the bytes of a TK_EMBED token, reading the resource on first use
+char *embed_contents(Token *tok) {
+  Literal *lit = token_lit(tok);
+  if (lit->contents)
+    return lit->contents;
+
+  FILE *fp = fopen(lit->embed_path, "rb");
+  if (!fp)
+    error_tok(tok, "%s: %s", lit->embed_path, strerror(errno));
+
+  char *buf = malloc(lit->cont_len);
+  if (fread(buf, 1, lit->cont_len, fp) != lit->cont_len)
+    error_tok(tok, "%s: unexpected end of file", lit->embed_path);
+  fclose(fp);
+
+  lit->contents = buf;
+  return buf;
+}
+
+// replaces a TK_EMBED token in place with a comma-separated list of
+// integer literals. used where the resource is not a global initializer.
+void expand_embed(Token *tok) {
+  unsigned char *bytes = (unsigned char *)embed_contents(tok);
+  int len = token_lit(tok)->cont_len;
+  char *buf = malloc(len * 4 + 1);
+  char *p = buf;
+
+  for (int i = 0; i < len; i++)
+    p += sprintf(p, i ? ",%d" : "%d", bytes[i]);
+
+  // the list is a source of its own, named after the resource, so that
+  // diagnostics show it rather than a line of the including file
+  char *path = token_lit(tok)->embed_path;
+  Token *list = tokenize(path, new_file_no(path), buf);
+  Token *next = tok->next;
+  bool at_bol = tok->at_bol;
+
+  Token *t = list;
+  while (t->next->kind != TK_EOF)
+    t = t->next;
+  t->next = next;
+
+  *tok = *list;
+  tok->at_bol = at_bol;
+}
+
 // visit all tokens in `tok` while evaluating preprocessing
 // macros and directives
 static Token *preprocess2(Token *tok) {
   Token head = {};
   Token *cur = &head;
+  Reader r = {NULL, &tok};
 
-  while (tok->kind != TK_EOF) {
-    // expand if that token is a macro
-    if (expand_macro(&tok, tok))
-      continue;
+  for (;;) {
+    prepare(&r);
+    if (!r.top && tok->kind == TK_EOF)
+      break;
 
-    // pass through if it is not a "#"
-    if (!is_hash(tok)) {
-      cur = cur->next = tok;
-      tok = tok->next;
+    // expand if that token is a macro, or else pass it through.
+    // directives are only recognized in the input itself
+    if (r.top || !is_hash(tok)) {
+      TokenRef t;
+      read_token(&r, &t);
+      if (!expand_macro(&r, &t))
+        cur = cur->next = emit_token(&t);
       continue;
     }
 
@@ -694,11 +1225,25 @@ static Token *preprocess2(Token *tok) {
 
     if (equal(tok, "include")) {
       char *path = read_include_path(&tok, tok->next);
+      tok = skip_line(tok);
 
       Token *tok2 = tokenize_file(path);
       if (!tok2)
         error_tok(tok, "%s", strerror(errno));
 
+      // the included tokens are new, so link them in rather than copy them
+      if (tok2->kind != TK_EOF) {
+        Token *last = tok2;
+        while (last->next->kind != TK_EOF)
+          last = last->next;
+        last->next = tok;
+        tok = tok2;
+      }
+      continue;
+    }
+
+    if (equal(tok, "embed")) {
+      Token *tok2 = read_embed(&tok, tok);
       tok = append(tok2, tok);
       continue;
     }
@@ -712,11 +1257,9 @@ static Token *preprocess2(Token *tok) {
       tok = tok->next;
       if (tok->kind != TK_IDENT)
         error_tok(tok, "macro name must be an identifier");
-      char *name = strndup(tok->str, tok->len);
+      char *name = tok->name;
       tok = skip_line(tok->next);
-
-      Macro *m = add_macro(name, true, NULL);
-      m->deleted = true;
+      undef_macro(name);
       continue;
     }
 
@@ -795,7 +1338,7 @@ static Token *preprocess2(Token *tok) {
 
 static void define_macro(char *name, char *buf) {
   Token *tok = tokenize("(internal)", 1, buf);
-  add_macro(name, true, tok);
+  add_macro(intern(name, strlen(name)), true, tok)->predefined = true;
 }
 
 static void init_macros(void) {
@@ -818,10 +1361,8 @@ static void init_macros(void) {
 
   define_macro("__STDC_HOSTED__",        "1");
   define_macro("__STDC_ISO_10646__",     "201103L");
-  define_macro("__STDC_NO_ATOMICS__",    "1");
   define_macro("__STDC_NO_COMPLEX__",    "1");
   define_macro("__STDC_NO_THREADS__",    "1");
-  define_macro("__STDC_NO_VLA__",        "1");
   define_macro("__STDC_UTF_16__",        "1");
   define_macro("__STDC_UTF_32__",        "1");
   define_macro("__STDC_VERSION__",       "201112L");
@@ -836,24 +1377,42 @@ static void init_macros(void) {
   define_macro("__x86_64",               "1");
   define_macro("__x86_64__",             "1");
   define_macro("linux",                  "1");
+  if (opt_fpic || opt_fpie) {
+    define_macro("__PIC__",              "2");
+    define_macro("__pic__",              "2");
+  }
+  if (opt_fpie) {
+    define_macro("__PIE__",              "2");
+    define_macro("__pie__",              "2");
+  }
+  define_macro("__ATOMIC_RELAXED",       "0");
+  define_macro("__ATOMIC_CONSUME",       "1");
+  define_macro("__ATOMIC_ACQUIRE",       "2");
+  define_macro("__ATOMIC_RELEASE",       "3");
+  define_macro("__ATOMIC_ACQ_REL",       "4");
+  define_macro("__ATOMIC_SEQ_CST",       "5");
   define_macro("__alignof__",            "alignof");
+  define_macro("__asm",                  "asm");
+  define_macro("__asm__",                "asm");
   define_macro("__const__",              "const");
   define_macro("__inline__",             "inline");
   define_macro("__restrict",             "restrict");
   define_macro("__restrict__",           "restrict");
   define_macro("__signed__",             "signed");
+  define_macro("__thread",               "_Thread_local");
   define_macro("__typeof__",             "typeof");
   define_macro("__volatile__",           "volatile");
 
-  file_macro = add_macro("__FILE__", true, NULL);
-  line_macro = add_macro("__LINE__", true, NULL);
+  file_macro = add_macro(intern("__FILE__", 8), true, NULL);
+  line_macro = add_macro(intern("__LINE__", 8), true, NULL);
 }
 
 static Token *join_strings(Token *t1, Token *t2) {
   char *buf = malloc(t1->len + t2->len - 1);
   // "abc" "xyz" -> "abcxyz"
   sprintf(buf, "%.*s%.*s", t1->len - 1, t1->str, t2->len - 1, t2->str + 1);
-  return tokenize(t1->filename, t1->file_no, buf);
+  File *file = token_file(t1);
+  return tokenize(file->name, file->file_no, buf);
 }
 
 // concatenate adjacent string literals into one as per the C spec
@@ -0,0 +1,65 @@
+/*
+ * call benchmark for alloycc: hot loops of calls with ten or more arguments,
+ * some of them passed on the stack, into functions compiled by gcc.
+ * the same loops compiled by gcc (in extern.c) are timed for comparison.
+ */
+
+int printf();
+
+struct timespec {
+  long tv_sec;
+  long tv_nsec;
+};
+int clock_gettime(int clk, struct timespec *ts);
+
+long sum10(char a, short b, int c, long d, int e, long f, char g, short h, int i, long j);
+double fsum10(double a, float b, double c, double d, double e, double f, double g, double h, float i, double j);
+long mix_args(long a, double b, long c, double d, long e, double f, long g, double h, long i, double j,
+              long k, double l, long m, double n, long o, double p, long q, double r, long s, double t);
+
+long loop_sum10(long n);
+double loop_fsum10(long n);
+long loop_mix_args(long n);
+
+#define CALLS 20000000
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(1, &ts); // CLOCK_MONOTONIC
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(char *name, double own, double gcc, int same) {
+  printf("%-9s %d calls: alloycc %6.3f s, gcc %6.3f s%s\n",
+         name, CALLS, own, gcc, same ? "" : " (results differ)");
+}
+
+int main() {
+  double t0 = now();
+  long s1 = 0;
+  for (long i = 0; i < CALLS; i++)
+    s1 += sum10(i, 2, 3, 4, 5, 6, 7, 8, 9, i);
+  double t1 = now();
+  long s2 = loop_sum10(CALLS);
+  double t2 = now();
+  report("sum10", t1 - t0, t2 - t1, s1 == s2);
+
+  t0 = now();
+  double f1 = 0;
+  for (long i = 0; i < CALLS; i++)
+    f1 += fsum10(i, 2, 3, 4, 5, 6, 7, 8, 9, i);
+  t1 = now();
+  double f2 = loop_fsum10(CALLS);
+  t2 = now();
+  report("fsum10", t1 - t0, t2 - t1, f1 == f2);
+
+  t0 = now();
+  s1 = 0;
+  for (long i = 0; i < CALLS; i++)
+    s1 += mix_args(i, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, i);
+  t1 = now();
+  s2 = loop_mix_args(CALLS);
+  t2 = now();
+  report("mix_args", t1 - t0, t2 - t1, s1 == s2);
+  return 0;
+}
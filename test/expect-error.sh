@@ -0,0 +1,15 @@
+#!/bin/bash
+# usage: expect-error.sh COMPILER MESSAGE CODE
+# checks that compiling CODE fails with a diagnostic containing MESSAGE
+COMPILER=$1
+MESSAGE=$2
+CODE=$3
+
+SRC=$(dirname $0)/tmp-error.c
+printf '%s\n' "$CODE" > $SRC
+
+if OUT=$($COMPILER $SRC 2>&1 >/dev/null) || ! grep -qF "$MESSAGE" <<< "$OUT"; then
+  echo "$CODE => error \"$MESSAGE\" expected, but got: $OUT"
+  exit 1
+fi
+echo "$CODE => $MESSAGE"
@@ -1,9 +1,11 @@
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 
 int ext1;
 int *ext2;
 int ext3 = 5;
+__thread int ext_tls = 7;
 
 int false_fn() { return 512; }
 int true_fn() { return 513; }
@@ -41,3 +43,95 @@ float add_float(float x, float y) {
 double add_double(double x, double y) {
   return x + y;
 }
+
+static void *thread_main(void *fn) {
+  return (void *)(long)((int (*)(void))fn)();
+}
+
+int run_in_thread(int (*fn)(void)) {
+  pthread_t th;
+  void *ret;
+  pthread_create(&th, NULL, thread_main, fn);
+  pthread_join(th, &ret);
+  return (long)ret;
+}
+
+typedef struct { int x, y; } Point;
+typedef struct { char *p; long n; } Span;
+typedef struct { float x, y; } Vec2f;
+typedef struct { double d; long l; } Mixed;
+typedef struct { char c[3]; } Small3;
+typedef struct { float a, b, c; } Float3;
+typedef struct { long a, b, c; } Big;
+
+Point point_add(Point a, Point b) { return (Point){a.x + b.x, a.y + b.y}; }
+long span_len(Span s) { return s.n + s.p[0]; }
+Vec2f vec2f_scale(Vec2f v, float k) { return (Vec2f){v.x * k, v.y * k}; }
+Mixed mixed_make(double d, long l) { return (Mixed){d, l}; }
+double mixed_sum(Mixed m) { return m.d + m.l; }
+Small3 small3_inc(Small3 s) { s.c[0]++; s.c[1]++; s.c[2]++; return s; }
+Float3 float3_add(Float3 a, Float3 b) { return (Float3){a.a + b.a, a.b + b.b, a.c + b.c}; }
+Big big_make(long a, long b, long c) { return (Big){a, b, c}; }
+long big_sum(Big b) { return b.a + b.b + b.c; }
+
+long points_sum(Point a, Point b, Point c, Point d, Point e, Point f, Point g) {
+  return a.x + b.x + c.x + d.x + e.x + f.x + g.x * 100 + g.y * 1000;
+}
+
+double mixed_many(long a, long b, long c, long d, long e, Mixed m, Mixed n) {
+  return a + b + c + d + e + m.d + m.l * 10 + n.d * 100 + n.l * 1000;
+}
+
+long apply_point(Point (*fn)(Point, Point), Point a, Point b) {
+  Point p = fn(a, b);
+  return p.x * 10 + p.y;
+}
+
+long apply_big(Big (*fn)(Big, long), Big b) {
+  Big r = fn(b, 2);
+  return r.a + r.b + r.c;
+}
+
+long sum10(char a, short b, int c, long d, int e, long f, char g, short h, int i, long j) {
+  return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g * 7 + h * 8 + i * 9 + j * 10;
+}
+
+double fsum10(double a, float b, double c, double d, double e, double f, double g, double h, float i, double j) {
+  return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g * 7 + h * 8 + i * 9 + j * 10;
+}
+
+long mix_args(long a, double b, long c, double d, long e, double f, long g, double h, long i, double j,
+              long k, double l, long m, double n, long o, double p, long q, double r, long s, double t) {
+  return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g * 7 + h * 8 + i * 9 + j * 10 +
+         k * 11 + l * 12 + m * 13 + n * 14 + o * 15 + p * 16 + q * 17 + r * 18 + s * 19 + t * 20;
+}
+
+long call_sum10(long (*fn)(char, short, int, long, int, long, char, short, int, long)) {
+  return fn(1, 2, 3, 4, 5, 6, -7, -8, 9, 10);
+}
+
+double call_fsum10(double (*fn)(double, float, double, double, double, double, double, double, float, double)) {
+  return fn(1, 2, 3, 4, 5, 6, 7, 8, 9, 10);
+}
+
+// the call loops of bench-call.c, compiled by gcc for comparison
+long loop_sum10(long n) {
+  long sum = 0;
+  for (long i = 0; i < n; i++)
+    sum += sum10(i, 2, 3, 4, 5, 6, 7, 8, 9, i);
+  return sum;
+}
+
+double loop_fsum10(long n) {
+  double sum = 0;
+  for (long i = 0; i < n; i++)
+    sum += fsum10(i, 2, 3, 4, 5, 6, 7, 8, 9, i);
+  return sum;
+}
+
+long loop_mix_args(long n) {
+  long sum = 0;
+  for (long i = 0; i < n; i++)
+    sum += mix_args(i, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, i);
+  return sum;
+}
@@ -0,0 +1,30 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+extern int counter;
+extern char greeting[];
+extern int (*fp)(void);
+extern int *counter_ptr;
+int bump(void);
+long sum_bytes(char *s);
+
+static void check(long expected, long actual, char *code) {
+  if (expected == actual) {
+    printf("%s => %ld\n", code, actual);
+    return;
+  }
+  printf("%s => %ld expected, but got %ld\n", code, expected, actual);
+  exit(1);
+}
+
+int main(void) {
+  check(5, counter, "counter");
+  check(7, bump(), "bump()");
+  check(7, counter, "counter");
+  check(9, fp(), "fp()");
+  check(9, *counter_ptr, "*counter_ptr");
+  check(1, counter_ptr == &counter, "counter_ptr == &counter");
+  check(532, sum_bytes(greeting), "sum_bytes(greeting)");
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * a shared library built by alloycc with -fPIC, used by shlib-main.c
+ * (built by gcc) to check the symbols it exports
+ */
+
+int counter = 5;
+char greeting[] = "hello";
+static int step = 2;
+
+int bump(void) {
+  counter += step;
+  return counter;
+}
+
+int (*fp)(void) = &bump;
+int *counter_ptr = &counter;
+
+long sum_bytes(char *s) {
+  long sum = 0;
+  for (; *s; s++)
+    sum += *s;
+  return sum;
+}
@@ -53,9 +53,74 @@ struct {int a[2];} g30[2] = {{1, 2}, 3, 4};
 struct {int a[2];} g31[2] = {1, 2, 3, 4};
 char g33[][4] = {'f', 'o', 'o', 0, 'b', 'a', 'r', 0};
 char *g34 = {"foo"};
+int g35[] = {1, -2, 0x10, {4}, 2 + 3, };
+double g36[] = {1, -1.5, 2.5f, 'a'};
+char *g37[4] = {g17 + 1, 0, "bar"};
+short g38[8] = {-1, 2};
+unsigned char g39[] = {255, 256, -1};
 
 float g40 = 1.5;
 double g41 = 0.0 ? 55 : (0, 1 + 1 * 5.0 / 2 * (double)2 * (int)2.0);
+char g42[] = {
+#embed "embed.bin"
+};
+int g43[] = {7,
+#embed "embed.bin" limit(3)
+, 9};
+long g44[] = {
+#embed "embed.bin" __limit__(1 + 1) prefix(5,) suffix(, 6)
+};
+char g45[] = {
+#embed "embed.bin" limit(0) if_empty(42)
+};
+char g46[4] = {
+#embed "embed.bin" limit(4)
+};
+
+int embed_local(void) {
+  unsigned char x[] = {
+#embed "embed.bin"
+  };
+  return sizeof(x) * 1000 + x[3];
+}
+
+int computed_goto(int n) {
+  static void *ops[] = {&&inc, &&dbl, &&done};
+  int code[] = {0, 1, 0, 2};
+  int pc = 0;
+  goto *ops[code[pc]];
+inc:
+  n++;
+  goto *ops[code[++pc]];
+dbl:
+  n *= 2;
+  goto *ops[code[++pc]];
+done:
+  return n;
+}
+
+int asm_add(int a, int b) {
+  int r;
+  asm("movl %1, %0\n\taddl %2, %0" : "=r"(r) : "r"(a), "r"(b));
+  return r;
+}
+
+int asm_named(void) {
+  int r;
+  asm("leal (%q[a],%q[b]), %[r]" : [r] "=r"(r) : [a] "r"(3L), [b] "r"(4L));
+  return r;
+}
+
+int asm_cpuid(void) {
+  unsigned a = 0, b, c, d;
+  __asm__ __volatile__("cpuid" : "+a"(a), "=b"(b), "=c"(c), "=d"(d));
+  return b != 0 && a != 0;
+}
+
+double asm_addsd(double x, double y) {
+  asm("addsd %1, %0" : "+x"(x) : "x"(y));
+  return x;
+}
 
 typedef struct Tree {
   int val;
@@ -76,6 +141,175 @@ Tree *tree = &(Tree){
 extern int ext1;
 extern int *ext2;
 static int ext3 = 3;
+extern __thread int ext_tls;
+
+_Thread_local int tls1 = 3;
+__thread long tls2;
+
+int run_in_thread(int (*fn)(void));
+
+int tls_bump(void) {
+  tls1 += 10;
+  tls2++;
+  ext_tls++;
+  return tls1 + tls2 + ext_tls;
+}
+
+int tls_local(void) {
+  static __thread int n;
+  return ++n;
+}
+
+typedef float v4sf __attribute__((vector_size(16)));
+typedef int v4si __attribute__((vector_size(16)));
+typedef __attribute__((vector_size(16))) unsigned char v16qu;
+typedef short v8hi __attribute__((vector_size(16)));
+typedef double v2df __attribute__((vector_size(16)));
+typedef long v2di __attribute__((vector_size(16)));
+
+v4si g_vec = {1, 2, 3, 4};
+
+v4sf vec_madd(v4sf a, v4sf b, float c) { return a * b + c; }
+v2df vec_args(long x, v2df a, double y, v2df b) { return (a - b) * y + x; }
+
+int vla_sum(int n) {
+  int a[n];
+  for (int i = 0; i < n; i++)
+    a[i] = i;
+  int sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += a[i];
+  return sum + sizeof(a);
+}
+
+int vla_2d(int n, int m) {
+  int a[n][m];
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < m; j++)
+      a[i][j] = i * m + j;
+  return a[n-1][m-1] + sizeof(a) + sizeof(a[0]);
+}
+
+int vla_loop(int n) {
+  char *first = 0;
+  int same = 1;
+  for (int i = 0; i < 100; i++) {
+    char buf[n];
+    if (!first)
+      first = buf;
+    else if (buf != first)
+      same = 0;
+    if (i % 2)
+      continue;
+    if (i == 50)
+      break;
+  }
+  int i = 0;
+  do {
+    char buf[n * 2];
+    buf[0] = i;
+  } while (++i < 10);
+  char buf[n];
+  return same && buf == first;
+}
+
+int vla_param(int n, int a[n]) {
+  return a[n-1];
+}
+
+int vla_param_2d(int n, int m[][n]) {
+  return m[1][n-1] + sizeof(m[0]);
+}
+
+int alloca_add(int n) {
+  return n + *({ int *p = __builtin_alloca(sizeof(int) * n); p[n-1] = 7; p + n - 1; });
+}
+
+typedef struct { int x, y; } Point;
+typedef struct { char *p; long n; } Span;
+typedef struct { float x, y; } Vec2f;
+typedef struct { double d; long l; } Mixed;
+typedef struct { char c[3]; } Small3;
+typedef struct { float a, b, c; } Float3;
+typedef struct { long a, b, c; } Big;
+
+Point point_add(Point a, Point b);
+long span_len(Span s);
+Vec2f vec2f_scale(Vec2f v, float k);
+Mixed mixed_make(double d, long l);
+double mixed_sum(Mixed m);
+Small3 small3_inc(Small3 s);
+Float3 float3_add(Float3 a, Float3 b);
+Big big_make(long a, long b, long c);
+long big_sum(Big b);
+long points_sum(Point a, Point b, Point c, Point d, Point e, Point f, Point g);
+double mixed_many(long a, long b, long c, long d, long e, Mixed m, Mixed n);
+long apply_point(Point (*fn)(Point, Point), Point a, Point b);
+long apply_big(Big (*fn)(Big, long), Big b);
+
+Point point_sub(Point a, Point b) { return (Point){a.x - b.x, a.y - b.y}; }
+Big big_scale(Big b, long k) { b.a *= k; b.b *= k; b.c *= k; return b; }
+
+Float3 float3_own(Float3 a, Small3 s, Mixed m) {
+  return (Float3){a.a + s.c[0], a.b + s.c[2], a.c + m.d};
+}
+
+long own_points(Point a, Point b, Point c, Point d, Point e, Point f, Point g) {
+  return a.x + b.x + c.x + d.x + e.x + f.x + g.x * 100 + g.y * 1000;
+}
+
+long sum10(char a, short b, int c, long d, int e, long f, char g, short h, int i, long j);
+double fsum10(double a, float b, double c, double d, double e, double f, double g, double h, float i, double j);
+long mix_args(long a, double b, long c, double d, long e, double f, long g, double h, long i, double j,
+              long k, double l, long m, double n, long o, double p, long q, double r, long s, double t);
+long call_sum10(long (*fn)(char, short, int, long, int, long, char, short, int, long));
+double call_fsum10(double (*fn)(double, float, double, double, double, double, double, double, float, double));
+
+long own_sum10(char a, short b, int c, long d, int e, long f, char g, short h, int i, long j) {
+  return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g * 7 + h * 8 + i * 9 + j * 10;
+}
+
+double own_fsum10(double a, float b, double c, double d, double e, double f, double g, double h, float i, double j) {
+  return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g * 7 + h * 8 + i * 9 + j * 10;
+}
+
+int cold_count;
+__attribute__((cold, noinline)) void cold_fn(void) { cold_count++; }
+void cold_fn2(int) __attribute__((__cold__));
+void cold_fn2(int n) { cold_count += n; }
+
+int sum_unlikely(int n) {
+  int sum = 0;
+  for (int i = 0; i < n; i++) {
+    if (__builtin_expect(i % 4 == 3, 0)) {
+      cold_fn();
+      if (i > 8)
+        break;
+      continue;
+    }
+    if (__builtin_expect(i % 2, 1))
+      sum += i;
+    else if (i == 0)
+      cold_fn2(10);
+    else
+      sum += 100;
+  }
+  return sum;
+}
+
+// true if the arm calling a cold function was moved out of the body
+int cold_arm_moved(int x) {
+  unsigned long start = (unsigned long)cold_arm_moved;
+  unsigned long cold = (unsigned long)&&l_cold;
+  unsigned long hot = (unsigned long)&&l_hot;
+  if (x) {
+    cold_fn2(x);
+  l_cold:
+    x++;
+  }
+l_hot:
+  return !(start <= cold && cold < hot);
+}
 
 int;
 struct {char a; int b;};
@@ -199,6 +433,17 @@ float add_float3(float x, float y, float z) {
 
 int M9(int x) { return x*x; }
 
+// unreferenced static symbols are not emitted, so undefined
+// references made only from them must not break the link
+int no_such_fn(void);
+extern int no_such_var;
+static int dead_fn(void) { return no_such_fn(); }
+static int *dead_ptr = &no_such_var;
+
+static int live_fn1(void);
+static int live_fn2(void) { return 7; }
+static int live_fn1(void) { return live_fn2() + 1; }
+
 char *func_fn(void) {
   return __func__;
 }
@@ -210,6 +455,8 @@ int main() {
   assert(0, strcmp("abc" "d" "\nefgh", "abcd\nefgh"), "strcmp(\"abc\" \"d\" \"\\nefgh\", \"abcd\\nefgh\")");
   assert(0, !strcmp("abc" "d", "abcd\nefgh"), "!strcmp(\"abc\" \"d\", \"abcd\\nefgh\")");
 
+  assert(8, live_fn1(), "live_fn1()");
+
   assert(5, sizeof(__func__), "sizeof(__func__)");
   assert(0, strcmp("main", __func__), "strcmp(\"main\", __func__)");
   assert(0, strcmp("func_fn", func_fn()), "strcmp(\"func_fn\", func_fn())");
@@ -254,6 +501,11 @@ assert(1, __STDC__, "__STDC__");
   assert(1, size\
 of(char), \
          "sizeof(char)");
+  assert(3, 1 + 2 /\
+/ + 10
+         , "1 + 2 // + 10");
+  assert(3, 1 /\
+* + 10 */ + 2, "1 /* + 10 */ + 2");
 
   assert(5,
 #if no_such_symbol == 0
@@ -906,11 +1158,132 @@ of(char), \
   ext2 = &ext1;
   assert(5, *ext2, "*ext2");
 
+  assert(22, tls_bump(), "tls_bump()");
+  assert(22, run_in_thread(tls_bump), "run_in_thread(tls_bump)");
+  assert(34, tls_bump(), "tls_bump()");
+  assert(23, tls1, "tls1");
+  assert(1, tls_local(), "tls_local()");
+  assert(2, tls_local(), "tls_local()");
+  assert(1, run_in_thread(tls_local), "run_in_thread(tls_local)");
+
+  assert(16, sizeof(v4sf), "sizeof(v4sf)");
+  assert(16, alignof(v2df), "alignof(v2df)");
+  assert(3, g_vec[2], "g_vec[2]");
+  assert(10, ({ v4si a={1,2,3,4}; a[0]+a[1]+a[2]+a[3]; }), "({ v4si a={1,2,3,4}; a[0]+a[1]+a[2]+a[3]; })");
+  assert(0, ({ v4si a={1,2}; a[2]+a[3]; }), "({ v4si a={1,2}; a[2]+a[3]; })");
+  assert(46, ({ v4si a={1,2,3,4}, b={10,20,30,40}; v4si c=a+b; c[3]+c[0]-9; }), "({ v4si a={1,2,3,4}, b={10,20,30,40}; v4si c=a+b; c[3]+c[0]-9; })");
+  assert(-9, ({ v4si a={1,2,3,4}, b={10,20,30,40}; (a-b)[0]; }), "({ v4si a={1,2,3,4}, b={10,20,30,40}; (a-b)[0]; })");
+  assert(96, ({ v4si a={1,2,3,4}, b={10,20,30,40}; (a*b)[2]*(b/a)[0]/10 + (b%(a+5))[1]; }), "({ v4si a={1,2,3,4}, b={10,20,30,40}; (a*b)[2]*(b/a)[0]/10 + (b%(a+5))[1]; })");
+  assert(8, ({ v4si a={3,5,6,7}; v4si b=a&6; b[0]+b[1]+(a|8)[2]-(a^7)[3]-12; }), "({ v4si a={3,5,6,7}; v4si b=a&6; b[0]+b[1]+(a|8)[2]-(a^7)[3]-12; })");
+  assert(-4, ({ v4si a={1,2,3,4}; (~a)[2]; }), "({ v4si a={1,2,3,4}; (~a)[2]; })");
+  assert(-3, ({ v4si a={1,2,3,4}; (-a)[2]; }), "({ v4si a={1,2,3,4}; (-a)[2]; })");
+  assert(7, ({ v4si a={1,2,3,4}; a += 4; a[2]; }), "({ v4si a={1,2,3,4}; a += 4; a[2]; })");
+  assert(9, ({ v4si a={1,2,3,4}; a[1] = 9; a[1]; }), "({ v4si a={1,2,3,4}; a[1] = 9; a[1]; })");
+  assert(5, ({ v4si a; a = 5; a[3]; }), "({ v4si a; a = 5; a[3]; })");
+  assert(15, ({ v4sf a={1.5,2,3,4}, b={2,2,2,2}; v4sf c=a*b+a/b; (int)(c[0]*4); }), "({ v4sf a={1.5,2,3,4}, b={2,2,2,2}; v4sf c=a*b+a/b; (int)(c[0]*4); })");
+  assert(385, sum10(1, 2, 3, 4, 5, 6, 7, 8, 9, 10), "sum10(1, 2, 3, 4, 5, 6, 7, 8, 9, 10)");
+  assert(159, sum10(1, 2, 3, 4, 5, 6, -7, -8, 9, 10), "sum10(1, 2, 3, 4, 5, 6, -7, -8, 9, 10)");
+  assert(159, own_sum10(1, 2, 3, 4, 5, 6, -7, -8, 9, 10), "own_sum10(1, 2, 3, 4, 5, 6, -7, -8, 9, 10)");
+  assert(159, call_sum10(own_sum10), "call_sum10(own_sum10)");
+  assert(385, fsum10(1, 2, 3, 4, 5, 6, 7, 8, 9, 10), "fsum10(1, 2, 3, 4, 5, 6, 7, 8, 9, 10)");
+  assert(385, own_fsum10(1, 2, 3, 4, 5, 6, 7, 8, 9, 10), "own_fsum10(1, 2, 3, 4, 5, 6, 7, 8, 9, 10)");
+  assert(385, call_fsum10(own_fsum10), "call_fsum10(own_fsum10)");
+  assert(2870, mix_args(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20), "mix_args(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20)");
+  assert(36, add_all3(1, 2, 3, 4, 5, 6, 7, 8, 0), "add_all3(1, 2, 3, 4, 5, 6, 7, 8, 0)");
+  assert(0, ({ char buf[100]; char c=-3; short s=-5; unsigned char u=200; fmt(buf, "%d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, c, s, u); strcmp(buf, "1 2 3 4 5 -3 -5 200"); }), "({ char buf[100]; char c=-3; short s=-5; unsigned char u=200; fmt(buf, \"%d %d %d %d %d %d %d %d\", 1, 2, 3, 4, 5, c, s, u); strcmp(buf, \"1 2 3 4 5 -3 -5 200\"); })");
+  assert(0, ({ char buf[100]; fmt(buf, "%d %d %d %d %d %d %d %.1f %.1f %.1f %.1f %.1f %.1f %.1f %.1f %.1f", 1, 2, 3, 4, 5, 6, 7, 1.5, 2.5, 3.5, 4.5, 5.5, 6.5, 7.5, 8.5, 9.5); strcmp(buf, "1 2 3 4 5 6 7 1.5 2.5 3.5 4.5 5.5 6.5 7.5 8.5 9.5"); }), "({ char buf[100]; fmt(buf, \"%d %d %d %d %d %d %d %.1f %.1f %.1f %.1f %.1f %.1f %.1f %.1f %.1f\", 1, 2, 3, 4, 5, 6, 7, 1.5, 2.5, 3.5, 4.5, 5.5, 6.5, 7.5, 8.5, 9.5); strcmp(buf, \"1 2 3 4 5 6 7 1.5 2.5 3.5 4.5 5.5 6.5 7.5 8.5 9.5\"); })");
+  assert(0, ({ char buf[100]; fmt(buf, "%.1f %.1f %.1f", 1.5, 2.5, 3.5); strcmp(buf, "1.5 2.5 3.5"); }), "({ char buf[100]; fmt(buf, \"%.1f %.1f %.1f\", 1.5, 2.5, 3.5); strcmp(buf, \"1.5 2.5 3.5\"); })");
+  assert(3142, ({ Point p = point_add((Point){1,2}, (Point){30,40}); p.x*100 + p.y; }), "({ Point p = point_add((Point){1,2}, (Point){30,40}); p.x*100 + p.y; })");
+  assert(6, point_add((Point){1,2}, (Point){3,4}).y, "point_add((Point){1,2}, (Point){3,4}).y");
+  assert(109, ({ char s[] = "hello"; span_len((Span){s, 5}); }), "({ char s[] = \"hello\"; span_len((Span){s, 5}); })");
+  assert(70, ({ Vec2f v = vec2f_scale((Vec2f){1.5, 2.5}, 4); (int)(v.x*10 + v.y); }), "({ Vec2f v = vec2f_scale((Vec2f){1.5, 2.5}, 4); (int)(v.x*10 + v.y); })");
+  assert(12, ({ Mixed m = mixed_make(2.5, 7); (int)(m.d*2) + m.l; }), "({ Mixed m = mixed_make(2.5, 7); (int)(m.d*2) + m.l; })");
+  assert(4, (int)mixed_sum((Mixed){1.5, 3}), "(int)mixed_sum((Mixed){1.5, 3})");
+  assert(234, ({ Small3 s = small3_inc((Small3){{1,2,3}}); s.c[0]*100 + s.c[1]*10 + s.c[2]; }), "({ Small3 s = small3_inc((Small3){{1,2,3}}); s.c[0]*100 + s.c[1]*10 + s.c[2]; })");
+  assert(3531, ({ Float3 f = float3_add((Float3){1,2,3}, (Float3){10,20,30}); (int)(f.a + f.b*10 + f.c*100); }), "({ Float3 f = float3_add((Float3){1,2,3}, (Float3){10,20,30}); (int)(f.a + f.b*10 + f.c*100); })");
+  assert(321, ({ Big b = big_make(1, 20, 300); b.a + b.b + b.c; }), "({ Big b = big_make(1, 20, 300); b.a + b.b + b.c; })");
+  assert(15, big_sum(big_make(4, 5, 6)), "big_sum(big_make(4, 5, 6))");
+  assert(8721, points_sum((Point){1,0}, (Point){2,0}, (Point){3,0}, (Point){4,0}, (Point){5,0}, (Point){6,0}, (Point){7,8}), "points_sum((Point){1,0}, (Point){2,0}, (Point){3,0}, (Point){4,0}, (Point){5,0}, (Point){6,0}, (Point){7,8})");
+  assert(8721, own_points((Point){1,0}, (Point){2,0}, (Point){3,0}, (Point){4,0}, (Point){5,0}, (Point){6,0}, (Point){7,8}), "own_points((Point){1,0}, (Point){2,0}, (Point){3,0}, (Point){4,0}, (Point){5,0}, (Point){6,0}, (Point){7,8})");
+  assert(4336, mixed_many(1, 2, 3, 4, 5, (Mixed){1.5, 2}, (Mixed){3, 4}), "mixed_many(1, 2, 3, 4, 5, (Mixed){1.5, 2}, (Mixed){3, 4})");
+  assert(74, apply_point(point_sub, (Point){10, 5}, (Point){3, 1}), "apply_point(point_sub, (Point){10, 5}, (Point){3, 1})");
+  assert(12, apply_big(big_scale, (Big){1, 2, 3}), "apply_big(big_scale, (Big){1, 2, 3})");
+  assert(9, big_scale((Big){1, 2, 3}, 3).c, "big_scale((Big){1, 2, 3}, 3).c");
+  assert(257, ({ Small3 s = {{1,2,3}}; Float3 f = float3_own((Float3){1,2,3}, s, (Mixed){0.5, 1}); (int)(f.a*100 + f.b*10 + f.c*2); }), "({ Small3 s = {{1,2,3}}; Float3 f = float3_own((Float3){1,2,3}, s, (Mixed){0.5, 1}); (int)(f.a*100 + f.b*10 + f.c*2); })");
+  assert(85, vla_sum(10), "vla_sum(10)");
+  assert(75, vla_2d(3, 4), "vla_2d(3, 4)");
+  assert(1, vla_loop(10), "vla_loop(10)");
+  assert(4, ({ int a[]={1,2,3,4}; vla_param(4, a); }), "({ int a[]={1,2,3,4}; vla_param(4, a); })");
+  assert(18, ({ int m[2][3]={{1,2,3},{4,5,6}}; vla_param_2d(3, m); }), "({ int m[2][3]={{1,2,3},{4,5,6}}; vla_param_2d(3, m); })");
+  assert(12, alloca_add(5), "alloca_add(5)");
+  assert(20, ({ int n=5; sizeof(int[n]); }), "({ int n=5; sizeof(int[n]); })");
+  assert(12, ({ int n=3; sizeof(char[n][n+1]); }), "({ int n=3; sizeof(char[n][n+1]); })");
+  assert(7, ({ int n=3; 2 + ({ int a[n]; a[2]=5; a[2]; }); }), "({ int n=3; 2 + ({ int a[n]; a[2]=5; a[2]; }); })");
+  assert(6, ({ int n=2, m=3; int a[n][m]; int (*p)[m] = a; p[1][2] = 6; a[1][2]; }), "({ int n=2, m=3; int a[n][m]; int (*p)[m] = a; p[1][2] = 6; a[1][2]; })");
+  assert(1, ({ int n=4; int a[n]; int *p = a; &a[3] == p + 3; }), "({ int n=4; int a[n]; int *p = a; &a[3] == p + 3; })");
+  assert(13, ({ v4sf a={1,2,3,4}, b={2,3,4,5}; (int)vec_madd(a, b, 1)[2]; }), "({ v4sf a={1,2,3,4}, b={2,3,4,5}; (int)vec_madd(a, b, 1)[2]; })");
+  assert(21, ({ v2df a={5,6}, b={1,2}; (int)vec_args(1, a, 5, b)[1]; }), "({ v2df a={5,6}, b={1,2}; (int)vec_args(1, a, 5, b)[1]; })");
+  assert(237, ({ v16qu a={200,1}; v16qu b=a+a+a+a+a; b[0]+b[1]; }), "({ v16qu a={200,1}; v16qu b=a+a+a+a+a; b[0]+b[1]; })");
+  assert(2, ({ v16qu a={250}; v16qu b=a/100; b[0]; }), "({ v16qu a={250}; v16qu b=a/100; b[0]; })");
+  assert(-6, ({ v8hi a={-1,2,3}; v8hi b=a*6; b[0]; }), "({ v8hi a={-1,2,3}; v8hi b=a*6; b[0]; })");
+  assert(1, ({ v2di a={1L<<40, 3}; v2di b=a*a; b[0]==0 && b[1]==9; }), "({ v2di a={1L<<40, 3}; v2di b=a*a; b[0]==0 && b[1]==9; })");
+  assert(1065353216, ({ v4sf a={1,2,3,4}; ((v4si)a)[0]; }), "({ v4sf a={1,2,3,4}; ((v4si)a)[0]; })");
+  assert(4, ({ v4si a={1,2,3,4}, b={4,3,2,1}; int t=1; (t ? a : b)[3]; }), "({ v4si a={1,2,3,4}, b={4,3,2,1}; int t=1; (t ? a : b)[3]; })");
+
+  assert(515, sum_unlikely(12), "sum_unlikely(12)");
+  assert(13, cold_count, "cold_count");
+  assert(1, cold_arm_moved(0), "cold_arm_moved(0)");
+  assert(7, ({ int x=3; if (__builtin_expect(x, 2)) x=7; else x=9; x; }), "({ int x=3; if (__builtin_expect(x, 2)) x=7; else x=9; x; })");
+  assert(8, ({ int *p=&tls1; *p=8; tls1; }), "({ int *p=&tls1; *p=8; tls1; })");
+
   assert(3, ({ int a[]={1,2,3,}; a[2]; }), "({ int a[]={1,2,3,}; a[2]; })");
   assert(1, ({ struct {int a,b,c;} x={1,2,3,}; x.a; }), "({ struct {int a,b,c;} x={1,2,3,}; x.a; })");
   assert(2, ({ enum {x,y,z,}; z; }), "({ enum {x,y,z,}; z; })");
 
+  assert(0, ({ char buf[4096]={0}; buf[0]+buf[100]+buf[4095]; }), "({ char buf[4096]={0}; buf[0]+buf[100]+buf[4095]; })");
+  assert(0, ({ char buf[4096]={0}; buf[1] = 1; buf[1] = 0; int i = 0; for (; i < 4096 && !buf[i]; i++); 4096 - i; }), "({ char buf[4096]={0}; ... 4096 - i; })");
+  assert(5, ({ long a[100]={0,0,5}; a[2]+a[3]+a[99]; }), "({ long a[100]={0,0,5}; a[2]+a[3]+a[99]; })");
+  assert(0, ({ int x[3] = {1,2,3}; int y[3] = {}; y[0]+y[1]+y[2]; }), "({ int x[3] = {1,2,3}; int y[3] = {}; y[0]+y[1]+y[2]; })");
+  assert(7, ({ struct {char a; int b; short c[7];} x={1,0,{0,2}}; x.a+x.b+x.c[0]+x.c[1]+x.c[6]+4; }), "({ struct {char a; int b; short c[7];} x={1,0,{0,2}}; x.a+x.b+x.c[0]+x.c[1]+x.c[6]+4; })");
+  assert(5, ({ union {int a; char b;} x={5}; x.a; }), "({ union {int a; char b;} x={5}; x.a; })");
+  assert(0, ({ char s[10]="ab"; s[2]+s[9]; }), "({ char s[10]=\"ab\"; s[2]+s[9]; })");
+  assert(0, ({ int r = 0; for (int i = 0; i < 3; i++) { int a[20] = {i}; a[0] = 9; r += a[1] + a[19]; } r; }), "({ ... { int a[20] = {i}; ... } r; })");
+
   assert(0, strcmp(g34, "foo"), "strcmp(g34, \"foo\")");
+  assert(5, sizeof(g35) / sizeof(*g35), "sizeof(g35) / sizeof(*g35)");
+  assert(-2, g35[1], "g35[1]");
+  assert(16, g35[2], "g35[2]");
+  assert(4, g35[3], "g35[3]");
+  assert(5, g35[4], "g35[4]");
+  assert(4, sizeof(g36) / sizeof(*g36), "sizeof(g36) / sizeof(*g36)");
+  assert(-3, g36[1] * 2, "g36[1] * 2");
+  assert(5, g36[2] * 2, "g36[2] * 2");
+  assert(97, g36[3], "g36[3]");
+  assert(0, strcmp(g37[0], "oobar"), "strcmp(g37[0], \"oobar\")");
+  assert(0, g37[1] || g37[3], "g37[1] || g37[3]");
+  assert(0, strcmp(g37[2], "bar"), "strcmp(g37[2], \"bar\")");
+  assert(-1, g38[0], "g38[0]");
+  assert(0, g38[7], "g38[7]");
+  assert(255, g39[0], "g39[0]");
+  assert(0, g39[1], "g39[1]");
+  assert(255, g39[2], "g39[2]");
+  assert(6, sizeof(g42), "sizeof(g42)");
+  assert(1, g42[0], "g42[0]");
+  assert(-128, g42[2], "g42[2]");
+  assert(-1, g42[3], "g42[3]");
+  assert(65, g42[5], "g42[5]");
+  assert(5, sizeof(g43) / sizeof(*g43), "sizeof(g43) / sizeof(*g43)");
+  assert(7, g43[0], "g43[0]");
+  assert(128, g43[3], "g43[3]");
+  assert(9, g43[4], "g43[4]");
+  assert(4, sizeof(g44) / sizeof(*g44), "sizeof(g44) / sizeof(*g44)");
+  assert(5, g44[0], "g44[0]");
+  assert(2, g44[2], "g44[2]");
+  assert(6, g44[3], "g44[3]");
+  assert(1, sizeof(g45), "sizeof(g45)");
+  assert(42, g45[0], "g45[0]");
+  assert(-1, g46[3], "g46[3]");
+  assert(6255, embed_local(), "embed_local()");
 
   // TODO: confirm if it is legal expression
   assert(1, ({ int x[3]=0,1,2; x[1]; }), "({ int x[3]=0,1,2; x[1]; })");
@@ -1100,6 +1473,70 @@ of(char), \
   assert(3, ({ int i=0; goto a; a: i++; b: i++; c: i++; i; }), "({ int i=0; goto a; a: i++; b: i++; c: i++; i; })");
   assert(2, ({ int i=0; goto e; d: i++; e: i++; f: i++; i; }), "({ int i=0; goto e; d: i++; e: i++; f: i++; i; })");
   assert(1, ({ int i=0; goto i; g: i++; h: i++; i: i++; i; }), "({ int i=0; goto i; g: i++; h: i++; i: i++; i; })");
+  assert(9, computed_goto(3), "computed_goto(3)");
+  assert(2, ({ int i=0; void *p=&&k; goto *p; j: i++; k: i++; l: i++; i; }), "({ int i=0; void *p=&&k; goto *p; j: i++; k: i++; l: i++; i; })");
+
+  assert(7, asm_add(3, 4), "asm_add(3, 4)");
+  assert(7, asm_named(), "asm_named()");
+  assert(1, asm_cpuid(), "asm_cpuid()");
+  assert(15, asm_addsd(1.5, 2.25) * 4, "asm_addsd(1.5, 2.25) * 4");
+  assert(8, ({ int x=5; asm("addl $3, %0" : "+r"(x)); x; }), "({ int x=5; asm(\"addl $3, %0\" : \"+r\"(x)); x; })");
+  assert(2, ({ int x=1; asm volatile("incl %0" : "+m"(x)); x; }), "({ int x=1; asm volatile(\"incl %0\" : \"+m\"(x)); x; })");
+  assert(42, ({ int x; asm("movl %1, %0" : "=r"(x) : "i"(40 + 2)); x; }), "({ int x; asm(\"movl %1, %0\" : \"=r\"(x) : \"i\"(40 + 2)); x; })");
+  assert(15, ({ int x; asm("addl %2, %0" : "=r"(x) : "0"(10), "r"(5)); x; }), "({ int x; asm(\"addl %2, %0\" : \"=r\"(x) : \"0\"(10), \"r\"(5)); x; })");
+  assert(3, ({ long x=-1; asm("movl $3, %k0" : "+r"(x)); x; }), "({ long x=-1; asm(\"movl $3, %k0\" : \"+r\"(x)); x; })");
+  assert(7, ({ int x; asm("movl $7, %%eax; movl %%eax, %0" : "=r"(x) : : "eax"); x; }), "({ int x; asm(\"movl $7, %%eax; movl %%eax, %0\" : \"=r\"(x) : : \"eax\"); x; })");
+  assert(3, ({ int x=3; asm("nop"); x; }), "({ int x=3; asm(\"nop\"); x; })");
+
+  assert(7, ({ _Atomic int x=3; x += 4; x; }), "({ _Atomic int x=3; x += 4; x; })");
+  assert(3, ({ _Atomic int x=3; x++; }), "({ _Atomic int x=3; x++; })");
+  assert(4, ({ _Atomic int x=3; x++; x; }), "({ _Atomic int x=3; x++; x; })");
+  assert(2, ({ _Atomic int x=3; --x; }), "({ _Atomic int x=3; --x; })");
+  assert(7, ({ _Atomic long x=10; x -= 3; }), "({ _Atomic long x=10; x -= 3; })");
+  assert(2, ({ _Atomic int x=6; x &= 3; x; }), "({ _Atomic int x=6; x &= 3; x; })");
+  assert(30, ({ _Atomic int x=6; x *= 5; }), "({ _Atomic int x=6; x *= 5; })");
+  assert(5, ({ _Atomic(int) x=5; x; }), "({ _Atomic(int) x=5; x; })");
+  assert(4, ({ _Atomic(int) x; sizeof(x); }), "({ _Atomic(int) x; sizeof(x); })");
+  assert(2, ({ int a[3]; int *_Atomic p=a; p += 2; p - a; }), "({ int a[3]; int *_Atomic p=a; p += 2; p - a; })");
+  assert(1, ({ _Atomic double d=1.5; d += 1; d == 2.5; }), "({ _Atomic double d=1.5; d += 1; d == 2.5; })");
+  assert(5, ({ int x=5; __atomic_fetch_add(&x, 3, __ATOMIC_SEQ_CST); }), "({ int x=5; __atomic_fetch_add(&x, 3, __ATOMIC_SEQ_CST); })");
+  assert(8, ({ int x=5; __atomic_fetch_add(&x, 3, __ATOMIC_SEQ_CST); x; }), "({ int x=5; __atomic_fetch_add(&x, 3, __ATOMIC_SEQ_CST); x; })");
+  assert(2, ({ int x=5; __atomic_sub_fetch(&x, 3, __ATOMIC_RELAXED); }), "({ int x=5; __atomic_sub_fetch(&x, 3, __ATOMIC_RELAXED); })");
+  assert(7, ({ int x=5; __atomic_or_fetch(&x, 2, __ATOMIC_SEQ_CST); }), "({ int x=5; __atomic_or_fetch(&x, 2, __ATOMIC_SEQ_CST); })");
+  assert(-56, ({ char c=100; __atomic_fetch_add(&c, 100, __ATOMIC_SEQ_CST); c; }), "({ char c=100; __atomic_fetch_add(&c, 100, __ATOMIC_SEQ_CST); c; })");
+  assert(59, ({ int x=5; __atomic_exchange_n(&x, 9, __ATOMIC_SEQ_CST) * 10 + x; }), "({ int x=5; __atomic_exchange_n(&x, 9, __ATOMIC_SEQ_CST) * 10 + x; })");
+  assert(175, ({ int x=5, e=5; __atomic_compare_exchange_n(&x, &e, 7, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) * 100 + x * 10 + e; }), "({ int x=5, e=5; __atomic_compare_exchange_n(&x, &e, 7, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) * 100 + x * 10 + e; })");
+  assert(55, ({ int x=5, e=3; __atomic_compare_exchange_n(&x, &e, 7, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) * 100 + x * 10 + e; }), "({ int x=5, e=3; __atomic_compare_exchange_n(&x, &e, 7, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) * 100 + x * 10 + e; })");
+  assert(56, ({ long x=5; __sync_val_compare_and_swap(&x, 5, 6) * 10 + x; }), "({ long x=5; __sync_val_compare_and_swap(&x, 5, 6) * 10 + x; })");
+  assert(0, ({ long x=5; __sync_bool_compare_and_swap(&x, 4, 6); }), "({ long x=5; __sync_bool_compare_and_swap(&x, 4, 6); })");
+  assert(4, ({ int x=5; __atomic_store_n(&x, 4, __ATOMIC_SEQ_CST); __atomic_load_n(&x, __ATOMIC_ACQUIRE); }), "({ int x=5; __atomic_store_n(&x, 4, __ATOMIC_SEQ_CST); __atomic_load_n(&x, __ATOMIC_ACQUIRE); })");
+  assert(3, ({ int x=5; __atomic_store_n(&x, 3, __ATOMIC_RELEASE); __sync_synchronize(); __atomic_thread_fence(__ATOMIC_SEQ_CST); x; }), "({ int x=5; __atomic_store_n(&x, 3, __ATOMIC_RELEASE); __sync_synchronize(); __atomic_thread_fence(__ATOMIC_SEQ_CST); x; })");
+  assert(1, ({ short x=0; __sync_lock_test_and_set(&x, 1); __sync_fetch_and_add(&x, 0); }), "({ short x=0; __sync_lock_test_and_set(&x, 1); __sync_fetch_and_add(&x, 0); })");
+  assert(3, ({ int x=5, o=__ATOMIC_RELEASE; __atomic_store_n(&x, 3, o); __atomic_thread_fence(o); x; }), "({ int x=5, o=__ATOMIC_RELEASE; __atomic_store_n(&x, 3, o); __atomic_thread_fence(o); x; })");
+  assert(5, ({ int v=3; int _Atomic (*p)=&v; *p += 2; v; }), "({ int v=3; int _Atomic (*p)=&v; *p += 2; v; })");
+
+  assert(3, __builtin_popcount(7), "__builtin_popcount(7)");
+  assert(32, __builtin_popcount(-1), "__builtin_popcount(-1)");
+  assert(64, __builtin_popcountl(-1), "__builtin_popcountl(-1)");
+  assert(31, __builtin_clz(1), "__builtin_clz(1)");
+  assert(0, __builtin_clz(-1), "__builtin_clz(-1)");
+  assert(60, __builtin_clzll(8), "__builtin_clzll(8)");
+  assert(3, __builtin_ctz(8), "__builtin_ctz(8)");
+  assert(40, __builtin_ctzl(1L << 40), "__builtin_ctzl(1L << 40)");
+  assert(13330, __builtin_bswap16(0x1234), "__builtin_bswap16(0x1234)");
+  assert(2018915346, __builtin_bswap32(0x12345678), "__builtin_bswap32(0x12345678)");
+  assert(1, __builtin_bswap64(0x0102030405060708) == 0x0807060504030201, "__builtin_bswap64(0x0102030405060708) == 0x0807060504030201");
+  assert(5, ({ int x=5; __builtin_expect(x, 0); }), "({ int x=5; __builtin_expect(x, 0); })");
+  assert(1, ({ int x=5; __builtin_expect(x == 5, 1); }), "({ int x=5; __builtin_expect(x == 5, 1); })");
+  assert(7, ({ int x=7; __builtin_prefetch(&x); __builtin_prefetch(&x, 0, 1); x; }), "({ int x=7; __builtin_prefetch(&x); __builtin_prefetch(&x, 0, 1); x; })");
+  assert(1, __builtin_constant_p(3 * 4 + 1), "__builtin_constant_p(3 * 4 + 1)");
+  assert(0, ({ int x=3; __builtin_constant_p(x); }), "({ int x=3; __builtin_constant_p(x); })");
+  assert(0, ({ char a[7]="abcdef", b[7]; __builtin_memcpy(b, a, 7); strcmp(a, b); }), "({ char a[7]=\"abcdef\", b[7]; __builtin_memcpy(b, a, 7); strcmp(a, b); })");
+  assert(1, ({ long a[40], b[40]; for (int i=0; i<40; i++) a[i]=i; __builtin_memcpy(b, a, sizeof(a)) == b && b[39] == 39; }), "({ long a[40], b[40]; for (int i=0; i<40; i++) a[i]=i; __builtin_memcpy(b, a, sizeof(a)) == b && b[39] == 39; })");
+  assert(39, ({ char a[23], b[23]; for (int i=0; i<23; i++) a[i]=i*2; int n=20; __builtin_memcpy(b, a, n); b[19] + b[1] - 1; }), "({ char a[23], b[23]; for (int i=0; i<23; i++) a[i]=i*2; int n=20; __builtin_memcpy(b, a, n); b[19] + b[1] - 1; })");
+  assert(-1, ({ int a[5]; __builtin_memset(a, 255, sizeof(a)); a[4]; }), "({ int a[5]; __builtin_memset(a, 255, sizeof(a)); a[4]; })");
+  assert(1806, ({ short a[3]={0}; int c=7; __builtin_memset(a, c, 5); a[1] + a[2]; }), "({ short a[3]={0}; int c=7; __builtin_memset(a, c, 5); a[1] + a[2]; })");
+  assert(3, ({ char a[300]; __builtin_memset(a, 3, 300); a[299]; }), "({ char a[300]; __builtin_memset(a, 3, 300); a[299]; })");
 
   assert(10, ({ int i=0; int j=0; for (;i<10;i++) { if (i>5) continue; j++; } i; }), "({ int i=0; int j=0; for (;i<10;i++) { if (i>5) continue; j++; } i; })");
   assert(6, ({ int i=0; int j=0; for (;i<10;i++) { if (i>5) continue; j++; } j; }), "({ int i=0; int j=0; for (;i<10;i++) { if (i>5) continue; j++; } j; })");
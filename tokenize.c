@@ -6,6 +6,23 @@
 
 char *current_filename;
 static char *current_input;
+static int current_file;
+
+// lexer state: the line of the current position, and whether the next token
+// starts a line or follows whitespace
+static int line_no;
+static bool at_bol;
+static bool has_space;
+
+// the current file's line table: the offset of the start of every line
+// after the first, recorded as the lexer passes newlines
+static int *line_offsets;
+static int line_count;
+static int line_capacity;
+
+// a de-spliced copy of a token that runs across a line splice
+static char *splice_buf;
+static char *splice_end;
 
 void error(char *fmt, ...) {
   va_list ap;
@@ -40,17 +57,38 @@ static void verror_at(char *filename, char *input, int line_no,
   fprintf(stderr, "\n");
 }
 
-void error_at(char *loc, char *fmt, ...) {
-  int line_no = 1;
-  for (char *p = current_input; p < loc; p++) {
-    if (*p == '\n')
-      line_no++;
+static void new_line(char *p) {
+  line_no++;
+  if (line_count == line_capacity) {
+    line_capacity = line_capacity ? line_capacity * 2 : 64;
+    line_offsets = realloc(line_offsets, sizeof(int) * line_capacity);
   }
+  line_offsets[line_count++] = p - current_input;
+}
 
+// binary-searches the line table for the line containing `loc`
+static int line_of(char *loc) {
+  int off = loc - current_input;
+  int lo = 0;
+  int hi = line_count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (line_offsets[mid] <= off)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo + 1;
+}
+
+void error_at(char *loc, char *fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
 
-  verror_at(current_filename, current_input, line_no, loc, fmt, ap);
+  if (splice_buf && splice_buf <= loc && loc <= splice_end)
+    verror_at(current_filename, splice_buf, line_no, loc, fmt, ap);
+  else
+    verror_at(current_filename, current_input, line_of(loc), loc, fmt, ap);
   exit(1);
 }
 
@@ -58,7 +96,8 @@ void error_tok(Token *tok, char *fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
 
-  verror_at(tok->filename, tok->input, tok->line_no, tok->str, fmt, ap);
+  File *file = token_file(tok);
+  verror_at(file->name, file->contents, tok->line_no, tok->str, fmt, ap);
   exit(1);
 }
 
@@ -66,11 +105,15 @@ void warn_tok(Token *tok, char *fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
 
-  verror_at(tok->filename, tok->input, tok->line_no, tok->str, fmt, ap);
+  File *file = token_file(tok);
+  verror_at(file->name, file->contents, tok->line_no, tok->str, fmt, ap);
 }
 
 /* compare token name (str) without consuming it (no checks are done against its kind) */
 bool equal(Token *tok, char *op) {
+  // most mismatches are decided by the first character
+  if (tok->str[0] != op[0])
+    return false;
   return strlen(op) == tok->len && !strncmp(tok->str, op, tok->len);
 }
 
@@ -91,6 +134,47 @@ Token *skip(Token *tok, char *op) {
   return tok->next;
 }
 
+// the text of a punctuator or keyword, for error messages
+static char *id_text(TokenId id) {
+  static char *multi_letter_ops[] = {
+    "<<=", ">>=", "...", "==", "!=", ">=", "<=", "->", "+=", "-=", "*=", "/=",
+    "%=", "++", "--", "&=", "|=", "^=", "&&", "||", "<<", ">>", "##",
+  };
+  static char *keywords[] = {
+    "void", "_Bool", "signed", "unsigned", "char", "short", "int", "long",
+    "float", "double", "struct", "union", "typedef", "enum", "extern",
+    "static", "_Alignas", "const", "volatile", "_Atomic", "_Thread_local",
+    "__attribute__", "if", "else", "do", "while", "for", "break", "continue",
+    "goto", "switch", "case", "default", "return", "sizeof", "alignof", "asm",
+  };
+
+  if (id < OP_SHL_ASSIGN) {
+    char *buf = calloc(1, 2);
+    buf[0] = id;
+    return buf;
+  }
+  if (id < KW_VOID)
+    return multi_letter_ops[id - OP_SHL_ASSIGN];
+  return keywords[id - KW_VOID];
+}
+
+/* consume token if it is the punctuator or keyword `id` */
+bool consume_id(Token **rest, Token *tok, TokenId id) {
+  if (tok->id == id) {
+    *rest = tok->next;
+    return true;
+  }
+  *rest = tok;
+  return false;
+}
+
+/* assert token is the punctuator or keyword `id` */
+Token *skip_id(Token *tok, TokenId id) {
+  if (tok->id != id)
+    error_tok(tok, "expected '%s'", id_text(id));
+  return tok->next;
+}
+
 char *expect_ident(Token **rest, Token *tok) {
   char *name = get_identifier(tok);
   *rest = tok->next;
@@ -100,8 +184,7 @@ char *expect_ident(Token **rest, Token *tok) {
 char *get_identifier(Token *tok) {
   if (tok->kind != TK_IDENT)
     error_tok(tok, "expected an identifier");
-  char *name = strndup(tok->str, tok->len);
-  return name;
+  return tok->name;
 }
 
 char *expect_string(Token **rest, Token *tok) {
@@ -112,13 +195,137 @@ char *expect_string(Token **rest, Token *tok) {
   return s;
 }
 
+// identifiers are interned: every distinct spelling gets one canonical
+// copy, so that the preprocessor and the parser compare names by pointer.
+// the table is open-addressed and kept at most half full
+static char **atoms;
+static int atoms_capacity;
+static int atoms_used;
+
+static unsigned hash_name(char *s, int len) {
+  unsigned h = 2166136261u;
+  for (int i = 0; i < len; i++)
+    h = (h ^ (unsigned char)s[i]) * 16777619u;
+  return h;
+}
+
+static void grow_atoms(void) {
+  char **old = atoms;
+  int old_capacity = atoms_capacity;
+
+  atoms_capacity = atoms_capacity ? atoms_capacity * 2 : 4096;
+  atoms = calloc(atoms_capacity, sizeof(char *));
+
+  for (int i = 0; i < old_capacity; i++) {
+    if (!old[i])
+      continue;
+    unsigned h = hash_name(old[i], strlen(old[i])) & (atoms_capacity - 1);
+    while (atoms[h])
+      h = (h + 1) & (atoms_capacity - 1);
+    atoms[h] = old[i];
+  }
+  free(old);
+}
+
+// returns the canonical copy of `s[0..len)`
+char *intern(char *s, int len) {
+  if (atoms_used * 2 >= atoms_capacity)
+    grow_atoms();
+
+  unsigned h = hash_name(s, len) & (atoms_capacity - 1);
+  for (; atoms[h]; h = (h + 1) & (atoms_capacity - 1)) {
+    char *atom = atoms[h];
+    if (atom[0] == s[0] && !strncmp(atom, s, len) && atom[len] == '\0')
+      return atom;
+  }
+
+  atoms_used++;
+  return atoms[h] = strndup(s, len);
+}
+
+// tokens are carved out of large chunks rather than allocated one by one,
+// so that a token list is mostly contiguous in memory. the arena can be
+// rewound to a mark, reusing its chunks
+#define TOKEN_CHUNK_SIZE 4096
+
+typedef struct TokenChunk TokenChunk;
+struct TokenChunk {
+  TokenChunk *next;
+  Token tokens[TOKEN_CHUNK_SIZE];
+};
+
+static TokenChunk *first_chunk;
+static TokenChunk *cur_chunk;
+static int chunk_used;
+
+Token *alloc_token(void) {
+  if (!cur_chunk || chunk_used == TOKEN_CHUNK_SIZE) {
+    TokenChunk *next = cur_chunk ? cur_chunk->next : first_chunk;
+    if (!next) {
+      next = malloc(sizeof(TokenChunk));
+      next->next = NULL;
+      if (cur_chunk)
+        cur_chunk->next = next;
+      else
+        first_chunk = next;
+    }
+    cur_chunk = next;
+    chunk_used = 0;
+  }
+
+  Token *tok = &cur_chunk->tokens[chunk_used++];
+  memset(tok, 0, sizeof(Token));
+  return tok;
+}
+
+// the source table: every input that has been tokenized
+static File **files;
+static int nfiles;
+
+// the literal table: payloads of literal tokens. index 0 means none
+static Literal *literals;
+static int nliterals = 1;
+static int literals_capacity;
+
+static int new_file(char *name, char *contents, int file_no) {
+  if ((nfiles & (nfiles - 1)) == 0)
+    files = realloc(files, sizeof(File *) * (nfiles ? nfiles * 2 : 1));
+
+  File *file = calloc(1, sizeof(File));
+  file->name = name;
+  file->contents = contents;
+  file->file_no = file_no;
+  files[nfiles] = file;
+  return nfiles++;
+}
+
+File *token_file(Token *tok) {
+  return files[tok->file];
+}
+
+Literal *token_lit(Token *tok) {
+  return &literals[tok->lit];
+}
+
+// gives a token a fresh, zeroed literal payload
+Literal *new_literal(Token *tok) {
+  if (nliterals >= literals_capacity) {
+    literals_capacity = literals_capacity ? literals_capacity * 2 : 1024;
+    literals = realloc(literals, sizeof(Literal) * literals_capacity);
+  }
+  tok->lit = nliterals++;
+  Literal *lit = token_lit(tok);
+  memset(lit, 0, sizeof(Literal));
+  return lit;
+}
+
 static Token *new_token(TokenKind kind, Token *cur, char *str, int len) {
-  Token *tok = calloc(1, sizeof(Token));
+  Token *tok = alloc_token();
   tok->kind = kind;
   tok->str = str;
   tok->len = len;
-  tok->filename = current_filename;
-  tok->input = current_input;
+  tok->file = current_file;
+  tok->line_no = line_no;
   cur->next = tok;
   return tok;
 }
@@ -135,58 +342,93 @@ static bool is_alnum(char c) {
   return is_alpha(c) || ('0' <= c && c <='9');
 }
 
-static bool is_keyword(Token *tok) {
-  static const char *keywords[] = {
-    "if",
-    "else",
-    "do",
-    "while",
-    "for",
-    "break",
-    "continue",
-
-    "goto",
-    "switch",
-    "case",
-    "default",
-
-    "return",
-
-    "sizeof",
-    "alignof",
-    "_Alignas",
-    "extern",
-    "static",
-    "const",
-    "volatile",
-
-    "void",
-    "_Bool",
-    "enum",
-
-    "signed",
-    "unsigned",
-
-    "char",
-    "short",
-    "int",
-    "long",
-    "float",
-    "double",
-
-    "struct",
-    "union",
+// the lexer's hot loops: the end of an identifier, a run of blanks, and
+// the next interesting character in a comment
+
+// space characters other than '\n', which the lexer handles itself
+static bool is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static char *scan_ident(char *p) {
+  while (is_alnum(*p))
+    p++;
+  return p;
+}
+
+static char *scan_blank(char *p) {
+  while (is_blank(*p))
+    p++;
+  return p;
+}
+
+// finds the first `c1`, `c2` or '\0'
+static char *scan_any(char *p, char c1, char c2) {
+  while (*p && *p != c1 && *p != c2)
+    p++;
+  return p;
+}
+
+// keywords are looked up with a perfect hash, in the style of gperf: a
+// keyword's hash is its length plus asso[] of its first and last letters,
+// where asso[] was searched for so that no two keywords collide. characters
+// that don't occur in those positions map beyond the table.
+// (adding a keyword requires searching for new asso[] values)
+#define MIN_KEYWORD_LEN 2
+#define MAX_KEYWORD_LEN 13
+#define MAX_HASH_VALUE  58
+
+static TokenId keyword_id(char *s, int len) {
+  static const unsigned char asso[256] = {
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 21,
+    59,  0,  0, 10, 13,  5, 18, 13,  0,  6, 59,  0, 24,  0,  0,  0,
+    59, 59,  7, 24, 22, 11, 22,  0, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+    59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59,
+  };
+
+  static const struct { char *name; TokenId id; } wordlist[] = {
+    {"", ID_NONE}, {"", ID_NONE}, {"", ID_NONE}, {"asm", KW_ASM}, {"", ID_NONE},
+    {"break", KW_BREAK}, {"", ID_NONE}, {"", ID_NONE}, {"", ID_NONE},
+    {"enum", KW_ENUM}, {"while", KW_WHILE}, {"extern", KW_EXTERN},
+    {"", ID_NONE}, {"return", KW_RETURN}, {"else", KW_ELSE}, {"do", KW_DO},
+    {"union", KW_UNION}, {"goto", KW_GOTO}, {"", ID_NONE}, {"case", KW_CASE},
+    {"", ID_NONE}, {"char", KW_CHAR}, {"", ID_NONE}, {"continue", KW_CONTINUE},
+    {"double", KW_DOUBLE}, {"alignof", KW_ALIGNOF}, {"if", KW_IF},
+    {"", ID_NONE}, {"for", KW_FOR}, {"", ID_NONE}, {"switch", KW_SWITCH},
+    {"int", KW_INT}, {"unsigned", KW_UNSIGNED}, {"", ID_NONE}, {"", ID_NONE},
+    {"volatile", KW_VOLATILE}, {"", ID_NONE}, {"const", KW_CONST},
+    {"_Atomic", KW_ATOMIC}, {"void", KW_VOID}, {"static", KW_STATIC},
+    {"long", KW_LONG}, {"default", KW_DEFAULT}, {"signed", KW_SIGNED},
+    {"", ID_NONE}, {"float", KW_FLOAT}, {"", ID_NONE}, {"typedef", KW_TYPEDEF},
+    {"sizeof", KW_SIZEOF}, {"", ID_NONE}, {"_Bool", KW_BOOL},
+    {"short", KW_SHORT}, {"struct", KW_STRUCT}, {"_Alignas", KW_ALIGNAS},
+    {"", ID_NONE}, {"__attribute__", KW_ATTRIBUTE}, {"", ID_NONE},
+    {"", ID_NONE}, {"_Thread_local", KW_THREAD_LOCAL},
   };
 
-  /* Keywords */
-  for (int i = 0; i < sizeof(keywords) / sizeof(*keywords); i++) {
-    const char *kw = keywords[i];
-    int len = strlen(kw);
+  if (len < MIN_KEYWORD_LEN || MAX_KEYWORD_LEN < len)
+    return ID_NONE;
 
-    if (strlen(kw) == tok->len && !strncmp(tok->str, kw, tok->len))
-      return true;
-  }
-  return false;
+  int key = len + asso[(unsigned char)s[0]] + asso[(unsigned char)s[len - 1]];
+  if (key > MAX_HASH_VALUE)
+    return ID_NONE;
+
+  char *name = wordlist[key].name;
+  if (name[0] == s[0] && !strncmp(name, s, len) && name[len] == '\0')
+    return wordlist[key].id;
+  return ID_NONE;
 }
 
 static bool is_hex(char c) {
@@ -204,51 +446,135 @@ static int from_hex(char c) {
     return c - 'A' + 10;
 }
 
-static Token *read_operators(Token *cur, char *start) {
-  // longer keywords must come earlier
-  static const char *multi_letter_ops[] = {
-    "<<=",
-    ">>=",
-    "...",
-
-    "==",
-    "!=",
-    ">=",
-    "<=",
-    "->",
-    "+=",
-    "-=",
-    "*=",
-    "/=",
-    "%=",
-    "++",
-    "--",
-    "&=",
-    "|=",
-    "^=",
-    "&&",
-    "||",
-    "<<",
-    ">>",
-    "##",
-  };
-
-  /* Reserved Symbol: Multi-letter punctuators */
-  for (int i = 0; i < sizeof(multi_letter_ops) / sizeof(*multi_letter_ops); i++) {
-    int len = strlen(multi_letter_ops[i]);
-
-    if (startswith(start , multi_letter_ops[i])) {
-      Token *token = new_token(TK_RESERVED, cur, start, len);
-      return token;
+// reads a punctuator, choosing the longest match with a DFA indexed by
+// the first character. returns its length, and its ID in `*id`
+static int read_punct(char *p, TokenId *id) {
+  switch (*p) {
+  case '<':
+    if (p[1] == '<') {
+      if (p[2] == '=') {
+        *id = OP_SHL_ASSIGN;
+        return 3;
+      }
+      *id = OP_SHL;
+      return 2;
+    }
+    if (p[1] == '=') {
+      *id = OP_LE;
+      return 2;
+    }
+    break;
+  case '>':
+    if (p[1] == '>') {
+      if (p[2] == '=') {
+        *id = OP_SHR_ASSIGN;
+        return 3;
+      }
+      *id = OP_SHR;
+      return 2;
+    }
+    if (p[1] == '=') {
+      *id = OP_GE;
+      return 2;
+    }
+    break;
+  case '.':
+    if (p[1] == '.' && p[2] == '.') {
+      *id = OP_ELLIPSIS;
+      return 3;
+    }
+    break;
+  case '=':
+    if (p[1] == '=') {
+      *id = OP_EQ;
+      return 2;
+    }
+    break;
+  case '!':
+    if (p[1] == '=') {
+      *id = OP_NE;
+      return 2;
+    }
+    break;
+  case '-':
+    if (p[1] == '>') {
+      *id = OP_ARROW;
+      return 2;
+    }
+    if (p[1] == '=') {
+      *id = OP_SUB_ASSIGN;
+      return 2;
+    }
+    if (p[1] == '-') {
+      *id = OP_DEC;
+      return 2;
+    }
+    break;
+  case '+':
+    if (p[1] == '=') {
+      *id = OP_ADD_ASSIGN;
+      return 2;
+    }
+    if (p[1] == '+') {
+      *id = OP_INC;
+      return 2;
+    }
+    break;
+  case '*':
+    if (p[1] == '=') {
+      *id = OP_MUL_ASSIGN;
+      return 2;
     }
+    break;
+  case '/':
+    if (p[1] == '=') {
+      *id = OP_DIV_ASSIGN;
+      return 2;
+    }
+    break;
+  case '%':
+    if (p[1] == '=') {
+      *id = OP_MOD_ASSIGN;
+      return 2;
+    }
+    break;
+  case '&':
+    if (p[1] == '=') {
+      *id = OP_AND_ASSIGN;
+      return 2;
+    }
+    if (p[1] == '&') {
+      *id = OP_LOGAND;
+      return 2;
+    }
+    break;
+  case '|':
+    if (p[1] == '=') {
+      *id = OP_OR_ASSIGN;
+      return 2;
+    }
+    if (p[1] == '|') {
+      *id = OP_LOGOR;
+      return 2;
+    }
+    break;
+  case '^':
+    if (p[1] == '=') {
+      *id = OP_XOR_ASSIGN;
+      return 2;
+    }
+    break;
+  case '#':
+    if (p[1] == '#') {
+      *id = OP_PASTE;
+      return 2;
+    }
+    break;
   }
 
-  /* Reserved Symbol: Single-letter punctuators */
-  /* NOTE: when put ahead of identifier detection, this will mis-detect identifiers that start with '_' */
-  if (ispunct(*start)) {
-    Token *token = new_token(TK_RESERVED, cur, start, 1);
-    return token;
-  }
+  // single-letter punctuators
+  *id = *p;
+  return 1;
 }
 
 static char read_escaped_char(char **pos, char *p) {
@@ -320,8 +646,9 @@ static Token *read_string_literal(Token *cur, char *start) {
   buf[len++] = '\0';
 
   Token *tok = new_token(TK_STR, cur, start, p - start + 1);
-  tok->contents = buf;
-  tok->cont_len = len;
+  Literal *lit = new_literal(tok);
+  lit->contents = buf;
+  lit->cont_len = len;
   return tok;
 }
 
@@ -342,8 +669,9 @@ static Token *read_char_literal(Token *cur, char *start) {
   p++;
 
   Token *tok = new_token(TK_NUM, cur, start, p - start);
-  tok->val = c;
-  tok->ty = ty_int;
+  Literal *lit = new_literal(tok);
+  lit->val = c;
+  lit->ty = ty_int;
   return tok;
 }
 
@@ -418,8 +746,9 @@ static Token *read_int_literal(Token *cur, char *start) {
   }
 
   Token *tok = new_token(TK_NUM, cur, start, p - start);
-  tok->val = val;
-  tok->ty = ty;
+  Literal *lit = new_literal(tok);
+  lit->val = val;
+  lit->ty = ty;
   return tok;
 }
 
@@ -446,123 +775,268 @@ static Token *read_number(Token *cur, char *start) {
 
   // discard the integer token, and rebuild one as floating point
   tok = new_token(TK_NUM, cur, start, end - start);
-  tok->fval = fval;
-  tok->ty = ty;
+  Literal *lit = new_literal(tok);
+  lit->fval = fval;
+  lit->ty = ty;
   return tok;
 }
 
 void convert_keywords(Token *tok) {
   for (Token *t = tok; t->kind != TK_EOF; t = t->next)
-    if (t->kind == TK_IDENT && is_keyword(t))
+    if (t->kind == TK_IDENT && t->id != ID_NONE)
       t->kind = TK_RESERVED;
 }
 
-static void add_line_info(Token *tok) {
-  char *p = current_input;
-  int line_no = 1;
-  bool at_bol = true;
-  bool has_space = false;
-  
-  do {
-    if (p == tok->str) {
-      tok->line_no = line_no;
-      tok->at_bol = at_bol;
-      tok->has_space = has_space;
-      tok = tok->next;
+static bool is_splice(char *p) {
+  return p[0] == '\\' && p[1] == '\n';
+}
+
+// skips a line comment, which a line splice extends to the next line
+static char *skip_line_comment(char *p) {
+  for (;;) {
+    p = scan_any(p, '\n', '\\');
+    if (*p != '\\')
+      return p;
+    if (is_splice(p)) {
+      p += 2;
+      new_line(p);
+    } else {
+      p++;
     }
+  }
+}
 
+// skips a block comment whose body starts at `p`
+static char *skip_block_comment(char *start, char *p) {
+  for (;;) {
+    p = scan_any(p, '*', '\n');
+    if (!*p)
+      error_at(start, "unclosed block comment");
     if (*p == '\n') {
-      line_no++;
-      at_bol = true;
-    } else if (isspace(*p)) {
-      has_space = true;
-    } else {
-      at_bol = false;
-      has_space = false;
+      p++;
+      new_line(p);
+      continue;
+    }
+
+    // the terminator may itself be split by line splices
+    char *q = p + 1;
+    while (is_splice(q))
+      q += 2;
+    if (*q == '/') {
+      for (char *r = p + 1; r < q; r += 2)
+        new_line(r + 2);
+      return q + 1;
+    }
+    p++;
+  }
+}
+
+// true if a string or char literal starting at `p` contains a line splice
+static bool quote_has_splice(char *p) {
+  char quote = *p++;
+  for (; *p && *p != quote && *p != '\n'; p++) {
+    if (*p == '\\') {
+      if (p[1] == '\n')
+        return true;
+      if (p[1])
+        p++;
+    }
+  }
+  return false;
+}
+
+// reads one token at `p`, or returns NULL if `p` doesn't start one
+static Token *read_token(Token *cur, char *p) {
+  /* Numeric Literal */
+  if (isdigit(*p) || (p[0] == '.' && isdigit(p[1])))
+    return read_number(cur, p);
+
+  /* String Literal */
+  if (*p == '"')
+    return read_string_literal(cur, p);
+
+  /* Character literal */
+  if (*p == '\'')
+    return read_char_literal(cur, p);
+
+  /* Identifier and keywords*/
+  if (is_alpha(*p)) {
+    char *p0 = p;
+    p = scan_ident(p + 1);
+    Token *tok = new_token(TK_IDENT, cur, p0, p - p0);
+    tok->id = keyword_id(p0, p - p0);
+    tok->name = intern(p0, p - p0);
+    return tok;
+  }
+
+  /* Single-letter and multi-letter punctuators */
+  /* NOTE: when put ahead of identifier detection, this will mis-detect identifiers that start with '_' */
+  if (ispunct(*p)) {
+    TokenId id;
+    int len = read_punct(p, &id);
+    Token *tok = new_token(TK_RESERVED, cur, p, len);
+    tok->id = id;
+    return tok;
+  }
+
+  return NULL;
+}
+
+// reads a token that runs across line splices. its text is copied without
+// the splices and read again from the copy, so the sub-lexers never see a
+// splice. returns the token and sets `*end` past its text in the input
+static Token *read_spliced_token(Token *cur, char *start, char **end) {
+  // a token ends at the end of the logical line; one that isn't a
+  // literal also ends at whitespace
+  bool quoted = (*start == '"' || *start == '\'');
+  int len = 0;
+  for (char *p = start; *p && *p != '\n'; p++) {
+    if (is_splice(p))
+      p++;
+    else if (!quoted && isspace(*p))
+      break;
+    else
+      len++;
+  }
+
+  char *buf = malloc(len + 1);
+  char *q = buf;
+  for (char *p = start; q < buf + len; p++) {
+    if (is_splice(p))
+      p++;
+    else
+      *q++ = *p;
+  }
+  *q = '\0';
+
+  splice_buf = buf;
+  splice_end = buf + len;
+  Token *tok = read_token(cur, buf);
+  splice_buf = NULL;
+  tok->file = new_file(current_filename, buf, files[current_file]->file_no);
+
+  // step over the token's text in the input, counting the lines it spans
+  char *p = start;
+  for (int n = 0; n < tok->len; n++) {
+    while (is_splice(p)) {
+      p += 2;
+      new_line(p);
     }
-  } while(*p++);
+    p++;
+  }
+  *end = p;
+  return tok;
 }
 
+// reads the input in a single pass. line splices are removed virtually,
+// and the line number, the line table and each token's at_bol/has_space
+// are computed as the input is read
 Token *tokenize(char *filename, int file_no, char *p) {
   current_filename = filename;
   current_input = p;
+  current_file = new_file(filename, p, file_no);
+  line_no = 1;
+  at_bol = true;
+  has_space = false;
+  line_offsets = NULL;
+  line_count = line_capacity = 0;
 
   Token head;
   head.next = NULL;
   Token *cur = &head;
 
   while(*p) {
-    /* Skip line comments */
-    if (startswith(p, "//")) {
-      p += 2;
-      while (*p != '\n')
-        p++;
-      continue;
-    }
-
-    /* Skip block comments */
-    if (startswith(p, "/*")) {
-      char *q = strstr(p + 2, "*/");
-      if (!q)
-        error_at(p, "unclosed block comment");
-      p = q + 2;
-      continue;
-    }
-
-    if (isspace(*p)) {
+    if (*p == '\n') {
       p++;
+      new_line(p);
+      at_bol = true;
       continue;
     }
 
-    /* Numeric Literal */
-    if (isdigit(*p) || (p[0] == '.' && isdigit(p[1]))) {
-      cur = read_number(cur, p);
-      p += cur->len;
-      continue;
-    }
-
-    /* String Literal */
-    if (*p == '"') {
-      cur = read_string_literal(cur, p);
-      p += cur->len;
+    if (is_splice(p)) {
+      p += 2;
+      new_line(p);
       continue;
     }
 
-    /* Character literal */
-    if (*p == '\'') {
-      cur = read_char_literal(cur, p);
-      p += cur->len;
-      continue;
+    /* Skip comments, whose openers may be split by line splices */
+    if (*p == '/') {
+      char *q = p + 1;
+      while (is_splice(q))
+        q += 2;
+
+      if (*q == '/' || *q == '*') {
+        for (char *r = p + 1; r < q; r += 2)
+          new_line(r + 2);
+        if (*q == '/')
+          p = skip_line_comment(q + 1);
+        else
+          p = skip_block_comment(p, q + 1);
+        has_space = true;
+        continue;
+      }
     }
 
-    /* Identifier and keywords*/
-    if (is_alpha(*p)) {
-      char *p0 = p++;
-      while (is_alnum(*p))
-        p++;
-      cur = new_token(TK_IDENT, cur, p0, p - p0);
+    if (is_blank(*p)) {
+      p = scan_blank(p + 1);
+      has_space = true;
       continue;
     }
 
-    /* Single-letter and multi-letter punctuators */
-    /* NOTE: when put ahead of identifier detection, this will mis-detect identifiers that start with '_' */
-    if (ispunct(*p)) {
-      cur = read_operators(cur, p);
-      p += cur->len;
-      continue;
+    Token *tok;
+    char *end;
+    if ((*p == '"' || *p == '\'') && quote_has_splice(p)) {
+      tok = read_spliced_token(cur, p, &end);
+    } else {
+      tok = read_token(cur, p);
+      if (!tok)
+        error_at(p, "invalid token");
+      end = p + tok->len;
+      if (is_splice(end))
+        tok = read_spliced_token(cur, p, &end);
     }
 
-    error_at(p, "invalid token");
+    tok->at_bol = at_bol;
+    tok->has_space = has_space;
+    at_bol = has_space = false;
+    cur = tok;
+    p = end;
   }
 
-  new_token(TK_EOF, cur, p, 0);
-  for (Token *t = head.next; t; t = t->next)
-    t->file_no = file_no;
-  add_line_info(head.next);
+  cur = new_token(TK_EOF, cur, p, 0);
+  cur->at_bol = at_bol;
+  cur->has_space = has_space;
 
+  File *file = files[current_file];
+  file->line_offsets = line_offsets;
+  file->line_count = line_count;
   return head.next;
 }
 
+// maps a regular file read-only, so the tokens point straight into the
+// page cache. the lexer needs the input to end with "\n\0", and bytes past
+// the end of a file in its last page read as zeros: a file that ends with a
+// newline and doesn't fill its last page is mapped as is. returns NULL for
+// other files, which are read into a buffer instead
+static char *map_file(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+    return NULL;
+
+  long size = st.st_size;
+  if (size == 0 || size % sysconf(_SC_PAGESIZE) == 0)
+    return NULL;
+
+  char *buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (buf == MAP_FAILED)
+    return NULL;
+  if (buf[size - 1] != '\n') {
+    munmap(buf, size);
+    return NULL;
+  }
+  return buf;
+}
+
 static char *read_file(char *path) {
   FILE *fp;
 
@@ -573,6 +1047,12 @@ static char *read_file(char *path) {
     fp = fopen(path, "r");
     if (!fp)
       return NULL;
+
+    char *buf = map_file(fileno(fp));
+    if (buf) {
+      fclose(fp);
+      return buf;
+    }
   }
 
   int buflen = 4096;
@@ -601,41 +1081,48 @@ static char *read_file(char *path) {
   return buf;
 }
 
-// removes backslashes folllowed by a newline
-static void remove_backslash_newline(char *p) {
-  char *q = p;
-
-  // we want to keep the number of newline characters so that
-  // the logical line number matches the actual one.
-  // this counter will maintain the number of newlines we are removing here
-  int cnt = 0;
-
-  while (*p) {
-    if (startswith(p, "\\\n")) {
-      p += 2;
-      cnt++;         // skip newlines
-    } else if (*p == '\n') {
-      *q++ = *p++;
-      for (; cnt > 0; cnt--)
-        *q++ = '\n'; // additionally insert 'borrowed' newlines at the nearest newline
-    } else {
-      *q++ = *p++;
-    }
+// tokenizes a file repeatedly, and reports the lexer's throughput
+void bench_lex(char *path) {
+  char *p = read_file(path);
+  if (!p)
+    error("%s: %s", path, strerror(errno));
+
+  long len = strlen(p);
+  int iters = (32 << 20) / len + 1;
+
+  // each run's tokens are dropped by rewinding the arena and the tables
+  TokenChunk *mark_chunk = cur_chunk;
+  int mark_used = chunk_used;
+  int mark_files = nfiles;
+  int mark_literals = nliterals;
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int j = 0; j < iters; j++) {
+    tokenize(path, 0, p);
+    cur_chunk = mark_chunk;
+    chunk_used = mark_used;
+    nfiles = mark_files;
+    nliterals = mark_literals;
   }
+  clock_gettime(CLOCK_MONOTONIC, &end);
 
-  *q = '\0';
+  double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  double mb = (double)len * iters / (1 << 20);
+  printf("%8.1f MB in %6.3f s: %8.1f MB/s\n", mb, secs, mb / secs);
+}
+
+// numbers a source file for the assembler's debug info
+int new_file_no(char *path) {
+  static int file_no;
+  if (!opt_E)
+    printf(".file %d %s\n", ++file_no, quote_string(path));
+  return file_no;
 }
 
 Token *tokenize_file(char *path) {
   char *p = read_file(path);
   if (!p)
     return NULL;
-
-  remove_backslash_newline(p);
-
-  static int file_no;
-  if (!opt_E)
-    printf(".file %d \"%s\"\n", ++file_no, path);
-
-  return tokenize(path, file_no, p);
+  return tokenize(path, new_file_no(path), p);
 }
@@ -55,6 +55,21 @@ Type *array_of(Type *base, int len) {
   return ty;
 }
 
+// GCC vector extension: `size` bytes of `base` elements, packed in one SSE register
+Type *vector_of(Type *base, int size) {
+  Type *ty = new_type(TY_VECTOR, size, size);
+  ty->base = base;
+  ty->array_len = size / size_of(base);
+  return ty;
+}
+
+Type *vla_of(Type *base, Node *len) {
+  Type *ty = new_type(TY_VLA, 8, 8);
+  ty->base = base;
+  ty->vla_len = len;
+  return ty;
+}
+
 Type *enum_type(void) {
   return new_type(TY_ENUM, 4, 4);
 }
@@ -87,17 +102,22 @@ bool is_numeric(Type *ty) {
   return is_integer(ty) || is_flonum(ty);
 }
 
+bool is_vector(Type *ty) {
+  return ty->kind == TY_VECTOR;
+}
+
 static bool is_scalar(Type *ty) {
   return is_numeric(ty) || is_pointer_like(ty);
 }
 
 // types having its base type that 'behaves like' a pointer
+// (vectors have an element type but are values)
 bool is_pointer_like(Type *ty) {
-  return ty->base;
+  return ty->base && ty->kind != TY_VECTOR;
 }
 
 static Type *get_common_type(Type *ty1, Type *ty2) {
-  if (ty1->base)
+  if (is_pointer_like(ty1))
     return pointer_to(ty1->base);
 
   if (ty1->kind == TY_DOUBLE || ty2->kind == TY_DOUBLE)
@@ -122,13 +142,58 @@ static Type *get_common_type(Type *ty1, Type *ty2) {
 }
 
 static void usual_arith_conv(Node **lhs, Node **rhs) {
+  if (is_vector((*lhs)->ty) || is_vector((*rhs)->ty))
+    error_tok((*lhs)->token, "invalid operands to a vector operation");
+
   Type *ty = get_common_type((*lhs)->ty, (*rhs)->ty);
   *lhs = new_node_cast(*lhs, ty);
   *rhs = new_node_cast(*rhs, ty);
 }
 
+static bool is_same_vector(Type *ty1, Type *ty2) {
+  return is_vector(ty1) && is_vector(ty2) && ty1->size == ty2->size &&
+         ty1->base->kind == ty2->base->kind &&
+         ty1->base->is_unsigned == ty2->base->is_unsigned;
+}
+
+// element-wise operation: a scalar operand is broadcast to every lane
+static void vector_conv(Node *node) {
+  Type *ty = is_vector(node->lhs->ty) ? node->lhs->ty : node->rhs->ty;
+
+  if (!is_vector(node->lhs->ty))
+    node->lhs = new_node_cast(node->lhs, ty);
+  if (!is_vector(node->rhs->ty))
+    node->rhs = new_node_cast(node->rhs, ty);
+
+  if (!is_same_vector(node->lhs->ty, node->rhs->ty))
+    error_tok(node->token, "incompatible vector types");
+
+  if (is_flonum(ty->base) &&
+      (node->kind == ND_MOD || node->kind == ND_BITAND ||
+       node->kind == ND_BITOR || node->kind == ND_BITXOR))
+    error_tok(node->token, "invalid operands to a floating-point vector");
+
+  node->ty = ty;
+}
+
 static void set_type_for_expr(Node *node) {
   switch(node->kind) {
+    case ND_LABEL_VAL:
+      node->ty = pointer_to(ty_void);
+      return;
+    case ND_CAS:
+      generate_type(node->cas_addr);
+      generate_type(node->cas_old);
+      generate_type(node->cas_new);
+      node->ty = ty_bool;
+      return;
+    case ND_EXCH:
+    case ND_FETCH_ADD:
+      node->ty = node->lhs->ty->base;
+      return;
+    case ND_FENCE:
+      node->ty = ty_void;
+      return;
     case ND_NUM:
       // for in-code numbers, proper types must already have been inferred at tokeninizer.
       // this is to catch the remaining "small numbers" that are generated internally.
@@ -143,6 +208,10 @@ static void set_type_for_expr(Node *node) {
     case ND_BITAND:
     case ND_BITOR:
     case ND_BITXOR:
+      if (is_vector(node->lhs->ty) || is_vector(node->rhs->ty)) {
+        vector_conv(node);
+        return;
+      }
       usual_arith_conv(&node->lhs, &node->rhs);
       node->ty = node->lhs->ty;
       return;
@@ -173,8 +242,14 @@ static void set_type_for_expr(Node *node) {
       node->ty = ty_int;
       return;
     case ND_BITNOT:
+      if (is_vector(node->lhs->ty) && is_flonum(node->lhs->ty->base))
+        error_tok(node->token, "invalid operand to a floating-point vector");
+      node->ty = node->lhs->ty;
+      return;
     case ND_SHL:
     case ND_SHR:
+      if (is_vector(node->lhs->ty))
+        error_tok(node->token, "vector shifts are not supported");
       node->ty = node->lhs->ty;
       return;
     case ND_VAR:
@@ -183,6 +258,8 @@ static void set_type_for_expr(Node *node) {
     case ND_COND:
       if (node->then->ty->kind == TY_VOID || node->els->ty->kind == TY_VOID) {
         node->ty = ty_void;
+      } else if (is_same_vector(node->then->ty, node->els->ty)) {
+        node->ty = node->then->ty;
       } else {
         usual_arith_conv(&node->then, &node->els);
         node->ty = node->then->ty;
@@ -190,7 +267,7 @@ static void set_type_for_expr(Node *node) {
       return;
     case ND_ADDR: {
       Type *ty = node->lhs->ty;
-      if (ty->kind == TY_ARRAY)
+      if (ty->kind == TY_ARRAY || ty->kind == TY_VLA)
         // adddress of an element of array should be pointer to the element type
         //e.g. for char arr[2],  char *p = &arr[1] (p is a pointer to char, the element type)
         node->ty = pointer_to(ty->base);